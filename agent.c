@@ -16,15 +16,21 @@
 #include "constraint.h"
 #include "dcop.h"
 #include "list.h"
+#include "profile.h"
 #include "resource.h"
+#include "roi.h"
+#include "scheduler.h"
+#include "termination.h"
 #include "view.h"
 
-#include <sim_api.h>
-
 #define TLM_SIZE 1024 // KBytes
 
 bool use_tlm = true;
 
+__thread agent_t *evaluated_agent = NULL;
+
+__thread view_t *evaluated_view = NULL;
+
 agent_t * agent_new() {
 	//agent_t *a = (agent_t *) calloc(1, sizeof(agent_t));
 	// allocate agents page-aligned, so that coherency traffic is only caused by message passing
@@ -49,6 +55,10 @@ agent_t * agent_new() {
 	a->tlm = tlm;
 
 	a->bytes_sent = 0;
+	a->messages_sent = 0;
+
+	a->dirty = true;
+	a->vacant = false;
 
 	return a;
 }
@@ -151,7 +161,7 @@ void agent_load_view(agent_t *a) {
 	lua_pop(a->L, 1);
 }
 
-static bool agent_is_neighbor(agent_t *a, agent_t *b) {
+bool agent_is_neighbor(agent_t *a, agent_t *b) {
 	for_each_entry(neighbor_t, n, &a->neighbors) {
 		if (n->agent->id == b->id) {
 			return true;
@@ -239,13 +249,15 @@ void agent_clear_agent_view(agent_t *a) {
 }
 
 double agent_evaluate(agent_t *a) {
+	PROFILE_BEGIN(t);
+
 	double r = 0;
 
 	if (skip_lua && a->has_lua_constraints) {
 		//console_disable();
 		//SimRoiEnd();
 		// TODO: should we actually do that? manual says there can only be a single (continuous?) ROI
-		SimSetInstrumentMode(SIM_OPT_INSTRUMENT_WARMUP);
+		roi_set_warmup();
 		//console_enable();
 	}
 
@@ -292,30 +304,132 @@ double agent_evaluate(agent_t *a) {
 	if (skip_lua && a->has_lua_constraints) {
 		//SimRoiStart();
 		//console_disable();
-		SimSetInstrumentMode(SIM_OPT_INSTRUMENT_DETAILED);
+		roi_set_detailed();
 		//console_enable();
 	}
 
+	PROFILE_END(a->profile[PROFILE_EVALUATE], t);
+
 	return r;
 }
 
+// the view is overridden for the calling thread only, so views of an agent can be rated concurrently
 double agent_evaluate_view(agent_t *a, view_t *v) {
-	view_t *_view = a->view;
+	agent_t *_agent = evaluated_agent;
+	view_t *_view = evaluated_view;
 
-	a->view = v;
+	evaluated_agent = a;
+	evaluated_view = v;
 
 	double eval = agent_evaluate(a);
 
-	a->view = _view;
+	evaluated_agent = _agent;
+	evaluated_view = _view;
 
 	return eval;
 }
 
+// lower bound on the rating of any completion of a view with undecided (unknown) resources
+double agent_bound(agent_t *a) {
+	// lua constraints can't be bounded
+	if (!a->has_native_constraints) {
+		return -INFINITY;
+	}
+
+	double b = 0;
+	bool bounded = true;
+
+	for_each_entry(constraint_t, c, &a->constraints) {
+		if (!c->bound) {
+			bounded = false;
+			continue;
+		}
+
+		double _b = c->bound(c);
+
+		if (_b == INFINITY) {
+			return INFINITY;
+		} else if (_b == -INFINITY) {
+			bounded = false;
+		} else {
+			b += _b;
+		}
+	}
+
+	return bounded ? b : -INFINITY;
+}
+
+double agent_bound_view(agent_t *a, view_t *v) {
+	agent_t *_agent = evaluated_agent;
+	view_t *_view = evaluated_view;
+
+	evaluated_agent = a;
+	evaluated_view = v;
+
+	double bound = agent_bound(a);
+
+	evaluated_agent = _agent;
+	evaluated_view = _view;
+
+	return bound;
+}
+
+// delta evaluation requires every constraint to be native and incrementally updatable
+bool agent_supports_delta(agent_t *a) {
+	if (a->has_lua_constraints || !a->has_native_constraints) {
+		return false;
+	}
+
+	for_each_entry(constraint_t, c, &a->constraints) {
+		if (!constraint_supports_delta(c)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// rates v and caches the state needed by agent_delta_update, a->view is set to v
+double agent_delta_reset_view(agent_t *a, view_t *v) {
+	double r = 0;
+
+	a->view = v;
+
+	for_each_entry(constraint_t, c, &a->constraints) {
+		r += c->reset(c);
+	}
+
+	return r;
+}
+
+// re-rates the view after the status of resource r has been changed
+double agent_delta_update(agent_t *a, resource_t *res) {
+	PROFILE_BEGIN(t);
+
+	double r = 0;
+
+	// unlike agent_evaluate we must not stop at INF: every constraint has to see every update
+	for_each_entry(constraint_t, c, &a->constraints) {
+		r += c->update(c, res);
+	}
+
+	PROFILE_END(a->profile[PROFILE_EVALUATE], t);
+
+	return r;
+}
+
 void agent_send(agent_t *s, agent_t *r, message_t *msg) {
+	PROFILE_BEGIN(t);
+
 	msg->from = s;
 
 	if (s) {
 		s->bytes_sent += msg->size;
+		s->messages_sent++;
+
+		msg->time = ++s->clock;
+
+		termination_sent(s, msg);
 	}
 
 	pthread_mutex_lock(&r->mt);
@@ -324,7 +438,15 @@ void agent_send(agent_t *s, agent_t *r, message_t *msg) {
 
 	pthread_cond_signal(&r->cv);
 
+	if (r->fiber) {
+		scheduler_wake(r->fiber, msg->time);
+	}
+
 	pthread_mutex_unlock(&r->mt);
+
+	if (s) {
+		PROFILE_END(s->profile[PROFILE_SEND], t);
+	}
 }
 
 void agent_broadcast(agent_t *s, dcop_t *dcop, message_t *msg) {
@@ -340,47 +462,123 @@ void agent_broadcast(agent_t *s, dcop_t *dcop, message_t *msg) {
 	message_free(msg);
 }
 
+// called with r->mt held, fibers park instead of blocking their worker
+static void agent_wait(agent_t *r) {
+	fiber_t *f = scheduler_current();
+
+	if (!f) {
+		pthread_cond_wait(&r->cv, &r->mt);
+
+		return;
+	}
+
+	scheduler_prepare_park(f);
+
+	pthread_mutex_unlock(&r->mt);
+
+	scheduler_park(f);
+
+	pthread_mutex_lock(&r->mt);
+}
+
+#define message_sender(m) ((m)->from ? (m)->from->id : 0)
+
+// in deterministic mode messages are delivered by timestamp, then sender id, otherwise in order of arrival
+static message_t * agent_next_message(agent_t *r, bool (*filter)(message_t *, void *), void *arg) {
+	message_t *msg = NULL;
+
+	for_each_entry(message_t, m, &r->msg_queue) {
+		if (filter && !filter(m, arg)) {
+			continue;
+		}
+
+		if (!scheduler_is_deterministic()) {
+			return m;
+		}
+
+		if (!msg || m->time < msg->time || (m->time == msg->time && message_sender(m) < message_sender(msg))) {
+			msg = m;
+		}
+	}
+
+	return msg;
+}
+
+// called once msg is removed from the queue of r
+static void agent_received(agent_t *r, message_t *msg) {
+	r->clock = (msg->time > r->clock ? msg->time : r->clock) + 1;
+
+	termination_received(r, msg);
+}
+
 message_t * agent_recv(agent_t *r) {
+	PROFILE_BEGIN(t);
+
 	pthread_mutex_lock(&r->mt);
 
 	if (list_empty(&r->msg_queue)) {
-		pthread_cond_wait(&r->cv, &r->mt);
+		agent_wait(r);
 	}
 
-	message_t *msg = list_first_entry(&r->msg_queue, message_t, _l);
+	PROFILE_END(r->profile[PROFILE_RECV_WAIT], t);
+
+	message_t *msg = agent_next_message(r, NULL, NULL);
 	list_del(&msg->_l);
 
 	pthread_mutex_unlock(&r->mt);
 
+	agent_received(r, msg);
+
+	return msg;
+}
+
+// returns NULL instead of waiting if no message is queued
+message_t * agent_try_recv(agent_t *r) {
+	message_t *msg = NULL;
+
+	pthread_mutex_lock(&r->mt);
+
+	if (!list_empty(&r->msg_queue)) {
+		msg = agent_next_message(r, NULL, NULL);
+		list_del(&msg->_l);
+	}
+
+	pthread_mutex_unlock(&r->mt);
+
+	if (msg) {
+		agent_received(r, msg);
+	}
+
 	return msg;
 }
 
 message_t * agent_recv_filter(agent_t *r, bool (*filter)(message_t *, void *), void *arg) {
+	PROFILE_BEGIN(t);
+
 	pthread_mutex_lock(&r->mt);
 
 	if (list_empty(&r->msg_queue)) {
-		pthread_cond_wait(&r->cv, &r->mt);
+		agent_wait(r);
 	}
 
 	message_t *msg = NULL;
 
 	while (!msg) {
-		for_each_entry(message_t, m, &r->msg_queue) {
-			if (filter(m, arg)) {
-				msg = m;
-				break;
-			}
-		}
+		msg = agent_next_message(r, filter, arg);
 
 		if (!msg) {
-			pthread_cond_wait(&r->cv, &r->mt);
+			agent_wait(r);
 		}
 	}
 
+	PROFILE_END(r->profile[PROFILE_RECV_WAIT], t);
+
 	list_del(&msg->_l);
 
 	pthread_mutex_unlock(&r->mt);
 
+	agent_received(r, msg);
+
 	return msg;
 }
 
@@ -389,7 +587,7 @@ void agent_refresh(agent_t *a) {
 		return;
 	}
 
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		resource_refresh(a->L, r);
 	}
 
@@ -401,6 +599,12 @@ void agent_refresh(agent_t *a) {
 }
 
 int agent_create_thread(agent_t *a, void * (*algorithm)(void *), void *arg) {
+	if (scheduler_is_enabled()) {
+		a->fiber = scheduler_spawn(a->id, algorithm, arg);
+
+		return (a->fiber ? 0 : -1);
+	}
+
 	if (a->id >= dcop_get_number_of_cores()) {
 		print_warning("creating more threads than physical cores available (sniper will most likely crash)\n");
 	}
@@ -422,6 +626,20 @@ int agent_create_thread(agent_t *a, void * (*algorithm)(void *), void *arg) {
 void * agent_cleanup_thread(agent_t *a) {
 	void *ret;
 
+	if (a->fiber) {
+		ret = scheduler_join(a->fiber);
+
+		// senders wake the fiber while holding the lock
+		pthread_mutex_lock(&a->mt);
+		fiber_t *f = a->fiber;
+		a->fiber = NULL;
+		pthread_mutex_unlock(&a->mt);
+
+		scheduler_free(f);
+
+		return ret;
+	}
+
 	pthread_join(a->tid, &ret);
 
 	return ret;
@@ -439,7 +657,7 @@ void agent_dump_view(agent_t *a) {
 int agent_has_conflicting_view(agent_t *a, int id) {
 	int n = 0;
 
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		resource_t *_r = view_get_resource(a->agent_view[id], r->index);
 
 		if (_r && agent_is_owner(a, r) && resource_get_owner(_r) == id) {
@@ -9,6 +9,8 @@
 
 #include "dcop.h"
 #include "list.h"
+#include "profile.h"
+#include "scheduler.h"
 #include "tlm.h"
 #include "view.h"
 
@@ -18,10 +20,15 @@ typedef struct agent {
 	lua_State *L;
 	int id;
 	pthread_t tid;
+	// set if the agent runs as a fiber of the M:N scheduler
+	fiber_t *fiber;
 	pthread_mutex_t mt;
 	pthread_cond_t cv;
 	struct list_head msg_queue;
 	size_t bytes_sent;
+	unsigned long messages_sent;
+	// Lamport clock
+	unsigned long clock;
 	view_t *view;
 	view_t **agent_view;
 	int number_of_neighbors;
@@ -29,6 +36,15 @@ typedef struct agent {
 	struct list_head constraints;
 	bool has_native_constraints;
 	bool has_lua_constraints;
+	// changed since the last solve (service mode)
+	bool dirty;
+	// departed agent whose id is kept until reused (service mode)
+	bool vacant;
+	struct termination *termination;
+	struct termination_state *termination_state;
+#ifdef DCOP_PROFILE
+	unsigned long long profile[PROFILE_PHASES];
+#endif
 	tlm_t *tlm;
 } agent_t;
 
@@ -43,12 +59,22 @@ typedef struct message {
 	agent_t *from;
 	void *buf;
 	size_t size;
+	bool control;
+	// logical time the message was sent at
+	unsigned long time;
 	void (*free)(tlm_t *, void *);
 	tlm_t *tlm;
 } message_t;
 
 extern bool use_tlm;
 
+extern __thread agent_t *evaluated_agent;
+
+extern __thread view_t *evaluated_view;
+
+// view rated by the constraints of a (overridden per thread by agent_evaluate_view)
+#define agent_get_view(a) ((a) == evaluated_agent ? evaluated_view : (a)->view)
+
 agent_t * agent_new();
 
 void agent_free(agent_t *a);
@@ -67,6 +93,8 @@ void agent_load_view(agent_t *a);
 
 void agent_load_neighbors(agent_t *a);
 
+bool agent_is_neighbor(agent_t *a, agent_t *b);
+
 void agent_load_agent_view(agent_t *a);
 
 void agent_load_constraints(agent_t *a);
@@ -77,12 +105,24 @@ double agent_evaluate(agent_t *a);
 
 double agent_evaluate_view(agent_t *a, view_t *v);
 
+double agent_bound(agent_t *a);
+
+double agent_bound_view(agent_t *a, view_t *v);
+
+bool agent_supports_delta(agent_t *a);
+
+double agent_delta_reset_view(agent_t *a, view_t *v);
+
+double agent_delta_update(agent_t *a, resource_t *res);
+
 void agent_send(agent_t *s, agent_t *r, message_t *msg);
 
 void agent_broadcast(agent_t *s, dcop_t *dcop, message_t *msg);
 
 message_t * agent_recv(agent_t *r);
 
+message_t * agent_try_recv(agent_t *r);
+
 message_t * agent_recv_filter(agent_t *r, bool (*filter)(message_t *, void *), void *arg);
 
 void agent_refresh(agent_t *a);
@@ -0,0 +1,444 @@
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent.h"
+#include "algorithm.h"
+#include "amgm.h"
+#include "console.h"
+#include "dcop.h"
+#include "list.h"
+#include "mgm.h"
+#include "resource.h"
+#include "termination.h"
+#include "view.h"
+
+/*
+ * Asynchronous MGM: there are no rounds, agents decide on whatever they know
+ * about their neighbors. Views and gains are tagged with versions, a gain is
+ * only considered while it refers to the latest view of a neighbor. An agent
+ * moves if its gain beats the current gains of its neighbors, concurrent
+ * claims are resolved in favour of the move with the higher gain (then the
+ * lower id).
+ *
+ * The run ends once all agents are idle and no message is in flight, which is
+ * detected by the termination component.
+ */
+
+typedef struct amgm_message {
+	enum {
+		AMGM_OK,
+		AMGM_GAIN,
+		AMGM_END,
+		AMGM_START
+	} type;
+	view_t *view;
+	int version;
+	double gain;
+} amgm_message_t;
+
+typedef struct amgm_agent {
+	mgm_agent_t mgm;
+	agent_t *agent;
+	int version;
+	int gain_version;
+	double gain;
+	double priority;
+	bool dirty;
+	// indexed by agent id
+	int *versions;
+	int *gain_versions;
+	double *gains;
+	int moves;
+	int conflicts;
+} amgm_agent_t;
+
+static algorithm_t _amgm;
+
+static int max_moves = 200;
+
+static termination_t *termination = NULL;
+
+#define amgm_message(m) ((amgm_message_t *) m->buf)
+
+#define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
+
+static void amgm_message_free(tlm_t *tlm, void *buf) {
+	amgm_message_t *msg = (amgm_message_t *) buf;
+
+	if (msg) {
+		if (msg->view) {
+			view_free(msg->view);
+		}
+
+		tlm_free(tlm, msg);
+	}
+}
+
+static message_t * amgm_message_new(amgm_agent_t *a, int type) {
+	tlm_t *tlm = a ? a->agent->tlm : NULL;
+
+	amgm_message_t *msg = (amgm_message_t *) tlm_malloc(tlm, sizeof(amgm_message_t));
+	msg->type = type;
+
+	return message_new(tlm, msg, sizeof(amgm_message_t), amgm_message_free);
+}
+
+static void send_ok(amgm_agent_t *a, agent_t *to) {
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		if (!to || n->agent == to) {
+			message_t *msg = amgm_message_new(a, AMGM_OK);
+			amgm_message(msg)->view = view_clone(a->agent->view);
+			amgm_message(msg)->version = a->version;
+			amgm_message(msg)->gain = a->priority;
+			agent_send(a->agent, n->agent, msg);
+		}
+	}
+}
+
+static void send_gain(amgm_agent_t *a) {
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		message_t *msg = amgm_message_new(a, AMGM_GAIN);
+		amgm_message(msg)->version = a->version;
+		amgm_message(msg)->gain = a->mgm.improve;
+		agent_send(a->agent, n->agent, msg);
+	}
+
+	a->gain = a->mgm.improve;
+	a->gain_version = a->version;
+}
+
+static void send_end(dcop_t *dcop) {
+	for_each_entry(agent_t, x, &dcop->agents) {
+		message_t *msg = amgm_message_new(NULL, AMGM_END);
+		message_set_control(msg);
+		agent_send(NULL, x, msg);
+	}
+}
+
+static bool beats(double gain, int id, double _gain, int _id) {
+	return gain > _gain || (gain == _gain && id < _id);
+}
+
+// merges the view of a neighbor, returns true if the agent lost resources to it
+static bool merge_view(amgm_agent_t *a, agent_t *from, view_t *view, double priority, bool *defended) {
+	int n = a->agent->dcop->hardware->number_of_resources;
+
+	resource_t *resources[n];
+	for_each_entry(resource_t, r, &a->agent->view->resources) {
+		resources[r->index] = r;
+	}
+
+	bool yielded = false;
+
+	for_each_entry(resource_t, r, &view->resources) {
+		resource_t *_r = resources[r->index];
+
+		if (resource_get_owner(r) == from->id) {
+			if (!agent_is_owner(a->agent, _r)) {
+				agent_claim_resource(from, _r);
+			} else if (beats(priority, from->id, a->priority, a->agent->id)) {
+				agent_claim_resource(from, _r);
+				yielded = true;
+			} else {
+				*defended = true;
+			}
+		} else if (resource_get_owner(_r) == from->id) {
+			_r->status = r->status;
+			_r->owner = r->owner;
+		}
+	}
+
+	return yielded;
+}
+
+static void handle_ok(amgm_agent_t *a, message_t *msg) {
+	agent_t *from = msg->from;
+
+	// outdated views are dropped
+	if (amgm_message(msg)->version <= a->versions[from->id]) {
+		return;
+	}
+
+	a->versions[from->id] = amgm_message(msg)->version;
+
+	view_copy(a->agent->agent_view[from->id], amgm_message(msg)->view);
+
+	bool defended = false;
+
+	if (merge_view(a, from, amgm_message(msg)->view, amgm_message(msg)->gain, &defended)) {
+		a->conflicts++;
+		a->version++;
+		send_ok(a, NULL);
+	} else if (defended) {
+		a->conflicts++;
+		a->version++;
+		send_ok(a, from);
+	}
+
+	a->dirty = true;
+}
+
+// returns true if the algorithm has to stop
+static bool handle_message(amgm_agent_t *a, message_t *msg) {
+	amgm_message_t *m = amgm_message(msg);
+
+	if (m->type == AMGM_END) {
+		return true;
+	}
+
+	if (m->type == AMGM_START) {
+		return false;
+	}
+
+	if (m->type == AMGM_OK) {
+		handle_ok(a, msg);
+	} else if (m->type == AMGM_GAIN) {
+		a->gains[msg->from->id] = m->gain;
+		a->gain_versions[msg->from->id] = m->version;
+	}
+
+	return false;
+}
+
+static void decide(amgm_agent_t *a) {
+	if (!a->dirty) {
+		return;
+	}
+
+	a->dirty = false;
+
+	a->mgm.rounds++;
+
+	a->mgm.eval = agent_evaluate(a->agent);
+	a->mgm.improve = 0;
+
+	// IMPROVEMENT: don't try to improve when already at optimal utility
+	if (a->mgm.eval != a->mgm.best_eval && a->moves < max_moves) {
+		mgm_find_assignment(&a->mgm);
+	}
+
+	// the gain refers to the current version of the view
+	if (a->mgm.improve != a->gain || a->version != a->gain_version) {
+		send_gain(a);
+	}
+}
+
+static bool can_move(amgm_agent_t *a) {
+	if (a->mgm.improve <= 0) {
+		return false;
+	}
+
+	// stale gains of neighbors that have moved since are ignored
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		int id = n->agent->id;
+
+		if (a->gain_versions[id] == a->versions[id] && beats(a->gains[id], id, a->mgm.improve, a->agent->id)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void move(amgm_agent_t *a) {
+	view_copy(a->agent->view, a->mgm.new_view);
+
+	a->version++;
+	a->priority = a->mgm.improve;
+	a->moves++;
+
+	send_ok(a, NULL);
+
+	a->mgm.improve = 0;
+	a->dirty = true;
+}
+
+static void * amgm(void *arg) {
+	amgm_agent_t *a = (amgm_agent_t *) arg;
+
+	tlm_touch(a->agent->tlm);
+
+	dcop_start_ROI(a->agent);
+
+	mgm_setup(&a->mgm);
+
+	int n = a->agent->dcop->number_of_agents + 1;
+	a->versions = (int *) tlm_malloc(a->agent->tlm, n * sizeof(int));
+	a->gain_versions = (int *) tlm_malloc(a->agent->tlm, n * sizeof(int));
+	a->gains = (double *) tlm_malloc(a->agent->tlm, n * sizeof(double));
+	for (int i = 0; i < n; i++) {
+		a->versions[i] = -1;
+		a->gain_versions[i] = -1;
+	}
+
+	a->version = 0;
+	a->gain_version = -1;
+	a->dirty = true;
+
+	message_t *msg = agent_recv(a->agent);
+	bool stop = handle_message(a, msg);
+	message_free(msg);
+
+	if (!stop) {
+		send_ok(a, NULL);
+	}
+
+	while (!stop) {
+		while (!stop && (msg = agent_try_recv(a->agent))) {
+			stop = handle_message(a, msg);
+			message_free(msg);
+		}
+
+		if (stop) {
+			break;
+		}
+
+		decide(a);
+
+		if (can_move(a)) {
+			move(a);
+			continue;
+		}
+
+		// idle until a message arrives
+		termination_set_passive(a->agent);
+
+		msg = agent_recv(a->agent);
+		stop = handle_message(a, msg);
+		message_free(msg);
+	}
+
+	a->mgm.eval = agent_evaluate(a->agent);
+
+	tlm_free(a->agent->tlm, a->versions);
+	tlm_free(a->agent->tlm, a->gain_versions);
+	tlm_free(a->agent->tlm, a->gains);
+
+	dcop_stop_ROI(a->agent);
+
+	return (void *) a;
+}
+
+static void amgm_usage() {
+	printf("\n");
+	printf("OPTIONS:\n");
+	printf("	--moves MAX, -m MAX\n");
+	printf("		maximum number of moves of an agent\n");
+	printf("\n");
+}
+
+static int parse_arguments(int argc, char **argv) {
+	struct option long_options[] = {
+		{ "moves", required_argument, NULL, 'm' },
+		{ 0 }
+	};
+
+	optind = 1;
+
+	while (true) {
+		int result = getopt_long(argc, argv, "m:", long_options, NULL);
+		if (result == -1) {
+			break;
+		}
+
+		int moves;
+
+		switch (result) {
+			case 'm':
+				moves = (int) strtol(optarg, NULL, 10);
+				if (moves <= 0) {
+					print_error("amgm: invalid number of moves given\n");
+					print("amgm: using default number of moves %i\n", max_moves);
+				} else {
+					max_moves = moves;
+					print("amgm: number of moves set to %i\n", max_moves);
+				}
+				break;
+
+			case '?':
+			case ':':
+			default:
+				print_error("amgm: failed to parse algorithm paramters\n");
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void amgm_init(dcop_t *dcop, int argc, char **argv) {
+	parse_arguments(argc, argv);
+
+	termination = termination_new(dcop, send_end);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		amgm_agent_t *_a = (amgm_agent_t *) tlm_malloc(a->tlm, sizeof(amgm_agent_t));
+
+		_a->agent = a;
+		_a->mgm.agent = a;
+
+		agent_create_thread(a, amgm, _a);
+	}
+	DEBUG print("\n");
+}
+
+static void amgm_cleanup(dcop_t *dcop) {
+	double total_initial_eval = 0;
+	double total_eval = 0;
+	unsigned long messages = 0;
+	size_t bytes = 0;
+	int moves = 0;
+	int conflicts = 0;
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		amgm_agent_t *_a = (amgm_agent_t *) agent_cleanup_thread(a);
+
+		DEBUG_MESSAGE(_a, "initial utility: %f\n", _a->mgm.initial_eval);
+		DEBUG_MESSAGE(_a, "current utility: %f\n", _a->mgm.eval);
+		DEBUG_MESSAGE(_a, "decisions: %i\n", _a->mgm.rounds);
+		DEBUG_MESSAGE(_a, "moves: %i (%i conflicts)\n", _a->moves, _a->conflicts);
+		DEBUG_MESSAGE(_a, "messages sent: %lu (%lu bytes)\n", a->messages_sent, a->bytes_sent);
+
+		total_initial_eval += _a->mgm.initial_eval;
+		total_eval += _a->mgm.eval;
+		messages += a->messages_sent;
+		bytes += a->bytes_sent;
+		moves += _a->moves;
+		conflicts += _a->conflicts;
+
+		view_free(_a->mgm.new_view);
+
+		tlm_free(a->tlm, _a);
+	}
+	DEBUG print("\n");
+
+	DEBUG print("total initial utility: %f\n", total_initial_eval);
+	DEBUG print("total current utility: %f\n", total_eval);
+	DEBUG print("total moves: %i (%i conflicts)\n", moves, conflicts);
+	DEBUG print("total messages sent: %lu (%lu bytes)\n", messages, bytes);
+	DEBUG print("termination waves: %i\n", termination->waves);
+	DEBUG print("\n");
+
+	termination_free(termination);
+	termination = NULL;
+}
+
+static void amgm_run(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, amgm_message_new(NULL, AMGM_START));
+	}
+}
+
+static void amgm_kill(dcop_t *dcop) {
+	send_end(dcop);
+}
+
+void amgm_register() {
+	_amgm = algorithm_new("amgm", amgm_init, amgm_cleanup, amgm_run, amgm_kill, amgm_usage);
+	dcop_register_algorithm(&_amgm);
+}
@@ -0,0 +1,6 @@
+#ifndef AMGM_H_
+#define AMGM_H_
+
+void amgm_register();
+
+#endif /* AMGM_H_ */
@@ -0,0 +1,144 @@
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barrier.h"
+#include "console.h"
+#include "scheduler.h"
+
+/*
+ * Sense-reversing combining tree barrier: every thread arrives at the leaf of
+ * its slot, the last thread arriving at a node continues to its parent. The
+ * thread completing the root runs the serial callback, flips the sense and
+ * wakes all others, which sleep on the sense with a futex (fibers yield their
+ * worker instead).
+ *
+ * Slots have to be distinct and in [0, n), e.g. the ids of agents minus one.
+ */
+
+static void futex_wait(int *addr, int val) {
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr) {
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static unsigned long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+barrier_t * barrier_new(int n, void (*serial)(void *), void *arg) {
+	barrier_t *b = (barrier_t *) calloc(1, sizeof(barrier_t));
+
+	b->number_of_threads = n;
+	b->serial = serial;
+	b->arg = arg;
+
+	int total = 0;
+	for (int m = n; ; m = (m + BARRIER_FANIN - 1) / BARRIER_FANIN) {
+		int nodes = (m + BARRIER_FANIN - 1) / BARRIER_FANIN;
+		total += nodes;
+		if (nodes <= 1) {
+			break;
+		}
+	}
+
+	b->nodes = (barrier_node_t *) aligned_alloc(64, total * sizeof(barrier_node_t));
+
+	// level by level, the children of a level are the nodes (or threads) of the previous one
+	barrier_node_t *level = b->nodes;
+	for (int m = n; ; ) {
+		int nodes = (m + BARRIER_FANIN - 1) / BARRIER_FANIN;
+
+		for (int i = 0; i < nodes; i++) {
+			level[i].count = (i < nodes - 1) ? BARRIER_FANIN : m - i * BARRIER_FANIN;
+			level[i].arrived = 0;
+			level[i].parent = (nodes > 1) ? &level[nodes + i / BARRIER_FANIN] : NULL;
+		}
+
+		if (nodes <= 1) {
+			break;
+		}
+
+		level += nodes;
+		m = nodes;
+	}
+
+	return b;
+}
+
+void barrier_free(barrier_t *b) {
+	if (b) {
+		free(b->nodes);
+		free(b);
+	}
+}
+
+// returns true if the thread completed node and all of its ancestors
+static bool barrier_arrive(barrier_node_t *node) {
+	while (node) {
+		if (__atomic_add_fetch(&node->arrived, 1, __ATOMIC_ACQ_REL) != node->count) {
+			return false;
+		}
+
+		// no thread arrives here again before the episode ends
+		__atomic_store_n(&node->arrived, 0, __ATOMIC_RELAXED);
+
+		node = node->parent;
+	}
+
+	return true;
+}
+
+// returns true for the thread that ran the serial callback
+bool barrier_wait(barrier_t *b, int slot) {
+	int sense = __atomic_load_n(&b->sense, __ATOMIC_ACQUIRE);
+
+	if (barrier_arrive(&b->nodes[slot / BARRIER_FANIN])) {
+		b->episodes++;
+
+		if (b->serial) {
+			b->serial(b->arg);
+		}
+
+		__atomic_store_n(&b->sense, !sense, __ATOMIC_RELEASE);
+
+		futex_wake(&b->sense);
+
+		return true;
+	}
+
+	unsigned long long start = now_ns();
+
+	while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) == sense) {
+		if (scheduler_current()) {
+			scheduler_yield();
+		} else {
+			futex_wait(&b->sense, sense);
+		}
+	}
+
+	unsigned long long wait = now_ns() - start;
+
+	__atomic_add_fetch(&b->waits, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&b->wait_ns, wait, __ATOMIC_RELAXED);
+
+	unsigned long long max = __atomic_load_n(&b->max_wait_ns, __ATOMIC_RELAXED);
+	while (wait > max && !__atomic_compare_exchange_n(&b->max_wait_ns, &max, wait, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	return false;
+}
+
+void barrier_print_stats(barrier_t *b, const char *name) {
+	double avg = b->waits ? (double) b->wait_ns / b->waits / 1000 : 0;
+
+	print_debug("%s barrier: %lu episodes, %lu waits, average wait %.3f us, maximum wait %.3f us\n", name, b->episodes, b->waits, avg, (double) b->max_wait_ns / 1000);
+}
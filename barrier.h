@@ -0,0 +1,34 @@
+#ifndef BARRIER_H_
+#define BARRIER_H_
+
+#include <stdbool.h>
+
+#define BARRIER_FANIN 4
+
+typedef struct barrier_node {
+	int count;
+	int arrived;
+	struct barrier_node *parent;
+} __attribute__((aligned(64))) barrier_node_t;
+
+typedef struct barrier {
+	int number_of_threads;
+	int sense;
+	barrier_node_t *nodes;
+	void (*serial)(void *);
+	void *arg;
+	unsigned long episodes;
+	unsigned long waits;
+	unsigned long long wait_ns;
+	unsigned long long max_wait_ns;
+} barrier_t;
+
+barrier_t * barrier_new(int n, void (*serial)(void *), void *arg);
+
+void barrier_free(barrier_t *b);
+
+bool barrier_wait(barrier_t *b, int slot);
+
+void barrier_print_stats(barrier_t *b, const char *name);
+
+#endif /* BARRIER_H_ */
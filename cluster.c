@@ -13,21 +13,112 @@
 
 static LIST_HEAD(clusters);
 
+// cluster and slot of every core, addressed by core index
+static cluster_t **core_cluster = NULL;
+static int *core_slot = NULL;
+
+// free or idle cores per tile, updated by the directories on every register
+static int *core_tile = NULL;
+static int *density = NULL;
+static int available = 0;
+
 static pthread_mutex_t cluster_m;
 static bool shutdown = false;
 
-static bool cluster_contains(cluster_t *c, resource_t *r) {
-	return (view_get_resource(c->view, r->index) != NULL);
+// number of rounds a cached directory entry stays valid (0 disables the cache)
+static int cache_lease = 0;
+
+#define cluster_contains(c, r) (core_cluster[(r)->index] == (c))
+
+// requests of an agent always go to the same worker of a cluster
+#define cluster_get_worker(c, a) ((c)->workers[(a)->agent->id % (c)->shards].agent)
+
+#define cluster_get_directory(a, r) cluster_get_worker(core_cluster[(r)->index], a)
+
+#define cluster_get_slot(index) (core_slot[index])
+
+static void cluster_add_core(cluster_t *c, resource_t *r) {
+	resource_t *_r = resource_new_tlm(c->directory->tlm);
+	memcpy(_r, r, sizeof(resource_t));
+	_r->tlm = c->directory->tlm;
+	_r->type = tlm_strdup(_r->tlm, r->type);
+
+	view_add_resource(c->view, _r);
+
+	c->owner = tlm_realloc(c->directory->tlm, c->owner, (c->size + 1) * sizeof(int));
+	c->status = tlm_realloc(c->directory->tlm, c->status, (c->size + 1) * sizeof(int));
+	c->seq = tlm_realloc(c->directory->tlm, c->seq, (c->size + 1) * sizeof(unsigned int));
+
+	c->owner[c->size] = r->owner;
+	c->status[c->size] = r->status;
+	c->seq[c->size] = 0;
+
+	core_cluster[r->index] = c;
+	core_slot[r->index] = c->size;
+
+	core_tile[r->index] = r->tile;
+	if (r->status != RESOURCE_STATUS_TAKEN || distrm_is_idle_agent(r->owner)) {
+		density[r->tile]++;
+		available++;
+	}
+
+	c->size++;
 }
 
-static agent_t * cluster_get_directory(resource_t *r) {
-	for_each_entry(cluster_t, c, &clusters) {
-		if (cluster_contains(c, r)) {
-			return c->directory;
-		}
+/*
+ * All workers of a cluster share its owner table. Every entry is protected by
+ * a seqlock: writers make the sequence odd with a CAS, which also serializes
+ * concurrent registers of the same core, readers retry until they saw an even
+ * and unchanged sequence.
+ */
+static void directory_claim_core(cluster_t *c, int index, agent_t *a) {
+	int slot = cluster_get_slot(index);
+
+	unsigned int s;
+	do {
+		s = __atomic_load_n(&c->seq[slot], __ATOMIC_RELAXED);
+	} while ((s & 1) || !__atomic_compare_exchange_n(&c->seq[slot], &s, s + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	// the odd sequence has to be visible before any of the entry stores
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	bool was_available = (c->status[slot] != RESOURCE_STATUS_TAKEN || distrm_is_idle_agent(c->owner[slot]));
+
+	__atomic_store_n(&c->owner[slot], a->id, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->status[slot], RESOURCE_STATUS_TAKEN, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&c->seq[slot], s + 2, __ATOMIC_RELEASE);
+
+	int delta = (distrm_is_idle_agent(a->id) ? 1 : 0) - (was_available ? 1 : 0);
+	if (delta) {
+		__atomic_add_fetch(&density[core_tile[index]], delta, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&available, delta, __ATOMIC_RELAXED);
 	}
+}
+
+// approximate, read without synchronization
+int cluster_get_density(int tile) {
+	return __atomic_load_n(&density[tile], __ATOMIC_RELAXED);
+}
 
-	return NULL;
+int cluster_get_available() {
+	return __atomic_load_n(&available, __ATOMIC_RELAXED);
+}
+
+static int directory_get_owner(cluster_t *c, int index) {
+	int slot = cluster_get_slot(index);
+
+	unsigned int s;
+	int owner;
+	do {
+		s = __atomic_load_n(&c->seq[slot], __ATOMIC_ACQUIRE);
+
+		owner = __atomic_load_n(&c->owner[slot], __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((s & 1) || __atomic_load_n(&c->seq[slot], __ATOMIC_RELAXED) != s);
+
+	return owner;
 }
 
 static bool filter_distrm_info(message_t *msg, void *core) {
@@ -38,8 +129,51 @@ static bool filter_distrm_info(message_t *msg, void *core) {
 	return (distrm_message(msg)->type == DISTRM_INFO && distrm_message(msg)->core == (resource_t *) core);
 }
 
+/*
+ * Every agent caches the owners it resolved. Ownership only changes when an
+ * invading agent accepts an offer, so entries are refreshed by the ACCEPT and
+ * REJECT messages the giving agents receive and by registering cores. Entries
+ * of other cores may go stale and expire after cache_lease rounds.
+ */
+void cluster_cache_new(distrm_agent_t *a) {
+	a->cache_hits = 0;
+	a->cache_misses = 0;
+
+	if (cache_lease > 0) {
+		a->cache = tlm_malloc(a->agent->tlm, a->agent->dcop->hardware->number_of_resources * sizeof(distrm_cache_entry_t));
+	} else {
+		a->cache = NULL;
+	}
+}
+
+void cluster_cache_free(distrm_agent_t *a) {
+	if (a->cache) {
+		tlm_free(a->agent->tlm, a->cache);
+		a->cache = NULL;
+	}
+}
+
+void cluster_cache_update(distrm_agent_t *a, int index, agent_t *owner) {
+	if (a->cache) {
+		a->cache[index].owner = owner;
+		a->cache[index].expires = distrm_get_round() + cache_lease;
+	}
+}
+
 agent_t * cluster_resolve_core(distrm_agent_t *a,  resource_t *r) {
-	agent_t *directory = cluster_get_directory(r);
+	if (a->cache) {
+		distrm_cache_entry_t *e = &a->cache[r->index];
+
+		if (e->owner && e->expires > distrm_get_round()) {
+			a->cache_hits++;
+
+			return e->owner;
+		}
+
+		a->cache_misses++;
+	}
+
+	agent_t *directory = cluster_get_directory(a, r);
 
 	message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_LOCATE);
 	distrm_message(msg)->core = r;
@@ -51,13 +185,119 @@ agent_t * cluster_resolve_core(distrm_agent_t *a,  resource_t *r) {
 
 	message_free(msg);
 
+	if (agent) {
+		cluster_cache_update(a, r->index, agent);
+	}
+
 	return agent;
 }
 
+static bool filter_distrm_info_batch(message_t *msg, void *unused) {
+	if (distrm_message(msg)->type == DISTRM_END) {
+		return true;
+	}
+
+	return (distrm_message(msg)->type == DISTRM_INFO_BATCH);
+}
+
+// collects the cores of v that are managed by c and not yet resolved into a new array
+static int * cluster_get_batch(distrm_agent_t *a, cluster_t *c, view_t *v, agent_t **owners, int *n) {
+	int *batch = NULL;
+
+	*n = 0;
+
+	int i = 0;
+	for_each_entry(resource_t, r, &v->resources) {
+		if (!owners[i] && cluster_contains(c, r)) {
+			if (!batch) {
+				batch = tlm_malloc(a->agent->tlm, (v->size - i) * sizeof(int));
+			}
+
+			batch[(*n)++] = r->index;
+		}
+
+		i++;
+	}
+
+	return batch;
+}
+
+// resolves the owners of all cores in v with one LOCATE per directory, owners[i] belongs to the i-th core
+void cluster_resolve_cores(distrm_agent_t *a, view_t *v, agent_t **owners) {
+	int indices[v->size];
+
+	int i = 0;
+	for_each_entry(resource_t, r, &v->resources) {
+		indices[i] = r->index;
+		owners[i] = NULL;
+
+		if (a->cache) {
+			distrm_cache_entry_t *e = &a->cache[r->index];
+
+			if (e->owner && e->expires > distrm_get_round()) {
+				a->cache_hits++;
+
+				owners[i] = e->owner;
+			} else {
+				a->cache_misses++;
+			}
+		}
+
+		i++;
+	}
+
+	int pending = 0;
+
+	for_each_entry(cluster_t, c, &clusters) {
+		int n;
+		int *batch = cluster_get_batch(a, c, v, owners, &n);
+		if (!batch) {
+			continue;
+		}
+
+		message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_LOCATE_BATCH);
+		distrm_message(msg)->num_cores = n;
+		distrm_message(msg)->cores = batch;
+
+		agent_send(a->agent, cluster_get_worker(c, a), msg);
+
+		pending++;
+	}
+
+	while (pending-- > 0) {
+		message_t *msg = agent_recv_filter(a->agent, filter_distrm_info_batch, NULL);
+
+		if (distrm_message(msg)->type == DISTRM_END) {
+			message_free(msg);
+
+			break;
+		}
+
+		for (int j = 0; j < distrm_message(msg)->num_cores; j++) {
+			int index = distrm_message(msg)->cores[j];
+			agent_t *owner = distrm_message(msg)->owners[j];
+
+			for (i = 0; i < v->size; i++) {
+				if (indices[i] == index) {
+					owners[i] = owner;
+				}
+			}
+
+			if (owner) {
+				cluster_cache_update(a, index, owner);
+			}
+		}
+
+		message_free(msg);
+	}
+}
+
 void cluster_register_core(distrm_agent_t *a, resource_t *r) {
 	agent_claim_resource(a->agent, r);
 
-	agent_t *directory = cluster_get_directory(r);
+	cluster_cache_update(a, r->index, a->agent);
+
+	agent_t *directory = cluster_get_directory(a, r);
 
 	message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REGISTER);
 	distrm_message(msg)->agent = a->agent;
@@ -66,40 +306,97 @@ void cluster_register_core(distrm_agent_t *a, resource_t *r) {
 	agent_send(a->agent, directory, msg);
 }
 
+// claims all cores of v and registers them with one message per directory
+void cluster_register_cores(distrm_agent_t *a, view_t *v) {
+	if (v->size == 0) {
+		return;
+	}
+
+	agent_t *owners[v->size];
+
+	int i = 0;
+	for_each_entry(resource_t, r, &v->resources) {
+		agent_claim_resource(a->agent, r);
+
+		cluster_cache_update(a, r->index, a->agent);
+
+		owners[i++] = NULL;
+	}
+
+	for_each_entry(cluster_t, c, &clusters) {
+		int n;
+		int *batch = cluster_get_batch(a, c, v, owners, &n);
+		if (!batch) {
+			continue;
+		}
+
+		message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REGISTER_BATCH);
+		distrm_message(msg)->agent = a->agent;
+		distrm_message(msg)->num_cores = n;
+		distrm_message(msg)->cores = batch;
+
+		agent_send(a->agent, cluster_get_worker(c, a), msg);
+	}
+}
+
 static void * directory_service(void *arg) {
-	cluster_t *c = (cluster_t *) arg;
+	directory_t *d = (directory_t *) arg;
+	cluster_t *c = d->cluster;
 
-	tlm_touch(c->directory->tlm);
+	tlm_touch(d->agent->tlm);
 
 	bool stop = false;
 	while (!stop) {
-		message_t *msg = agent_recv(c->directory);
+		message_t *msg = agent_recv(d->agent);
 
-		resource_t *r;
+		int index;
+		message_t *response;
 
 		switch(distrm_message(msg)->type) {
 			case DISTRM_REGISTER:
-				r = view_get_resource(c->view, distrm_message(msg)->core->index);
-				agent_claim_resource(distrm_message(msg)->agent, r);
+				index = distrm_message(msg)->core->index;
+				directory_claim_core(c, index, distrm_message(msg)->agent);
 
-				//print("directory %i: received register message (agent %i: core %i)\n", c->id, msg->from->id, r->index);
+				//print("directory %i: received register message (agent %i: core %i)\n", c->id, msg->from->id, index);
 
 				resource_free(distrm_message(msg)->core);
 
 				break;
 
 			case DISTRM_LOCATE:
-				r = view_get_resource(c->view, distrm_message(msg)->core->index);
+				index = distrm_message(msg)->core->index;
 
-				//print("directory %i: received locate message (agent %i: core %i)\n", c->id, msg->from->id, r->index);
+				//print("directory %i: received locate message (agent %i: core %i)\n", c->id, msg->from->id, index);
 
-				agent_t *agent = distrm_get_agent(c->directory->dcop, r->owner);
+				agent_t *agent = distrm_get_agent(d->agent->dcop, directory_get_owner(c, index));
 
-				message_t *response = distrm_message_new(c->directory->tlm, DISTRM_INFO);
+				response = distrm_message_new(d->agent->tlm, DISTRM_INFO);
 				distrm_message(response)->agent = agent;
 				distrm_message(response)->core = distrm_message(msg)->core;
 
-				agent_send(c->directory, msg->from, response);
+				agent_send(d->agent, msg->from, response);
+				break;
+
+			case DISTRM_REGISTER_BATCH:
+				for (int i = 0; i < distrm_message(msg)->num_cores; i++) {
+					directory_claim_core(c, distrm_message(msg)->cores[i], distrm_message(msg)->agent);
+				}
+				break;
+
+			case DISTRM_LOCATE_BATCH:
+				response = distrm_message_new(d->agent->tlm, DISTRM_INFO_BATCH);
+				distrm_message(response)->num_cores = distrm_message(msg)->num_cores;
+				distrm_message(response)->cores = tlm_malloc(d->agent->tlm, distrm_message(msg)->num_cores * sizeof(int));
+				distrm_message(response)->owners = tlm_malloc(d->agent->tlm, distrm_message(msg)->num_cores * sizeof(agent_t *));
+
+				for (int i = 0; i < distrm_message(msg)->num_cores; i++) {
+					index = distrm_message(msg)->cores[i];
+
+					distrm_message(response)->cores[i] = index;
+					distrm_message(response)->owners[i] = distrm_get_agent(d->agent->dcop, directory_get_owner(c, index));
+				}
+
+				agent_send(d->agent, msg->from, response);
 				break;
 
 			case DISTRM_END:
@@ -114,12 +411,25 @@ static void * directory_service(void *arg) {
 		message_free(msg);
 	}
 
-	return (void *) c;
+	return (void *) d;
 }
 
-int cluster_load(dcop_t *dcop, int size) {
+int cluster_load(dcop_t *dcop, int size, int shards, int lease) {
 	int n = 0;
 
+	cache_lease = lease;
+
+	core_cluster = calloc(dcop->hardware->number_of_resources, sizeof(cluster_t *));
+	core_slot = calloc(dcop->hardware->number_of_resources, sizeof(int));
+
+	core_tile = calloc(dcop->hardware->number_of_resources, sizeof(int));
+	density = calloc(dcop->hardware->number_of_tiles + 1, sizeof(int));
+	available = 0;
+
+	// ids of directory workers follow the idle agent
+	int id = 1;
+
+	// cores are assigned to clusters in contiguous blocks of size
 	int i = 0;
 	cluster_t *c;
 	for_each_entry(resource_t, r, &dcop->hardware->view->resources) {
@@ -129,7 +439,7 @@ int cluster_load(dcop_t *dcop, int size) {
 			directory->dcop = dcop;
 
 			n++;
-			directory->id = dcop->number_of_agents + 1 + n;
+			directory->id = dcop->number_of_agents + 1 + id++;
 
 			c = tlm_malloc(directory->tlm, sizeof(cluster_t));
 			c->directory = directory;
@@ -138,21 +448,33 @@ int cluster_load(dcop_t *dcop, int size) {
 
 			c->view = view_new_tlm(c->directory->tlm);
 			c->size = 0;
+			c->owner = NULL;
+			c->status = NULL;
+			c->seq = NULL;
+
+			c->shards = shards;
+			c->workers = tlm_malloc(directory->tlm, shards * sizeof(directory_t));
 
-			agent_create_thread(c->directory, directory_service, c);
+			for (int j = 0; j < shards; j++) {
+				c->workers[j].cluster = c;
+
+				if (j == 0) {
+					c->workers[j].agent = directory;
+				} else {
+					c->workers[j].agent = agent_new();
+					c->workers[j].agent->dcop = dcop;
+					c->workers[j].agent->id = dcop->number_of_agents + 1 + id++;
+				}
+
+				agent_create_thread(c->workers[j].agent, directory_service, &c->workers[j]);
+			}
 
 			list_add_tail(&c->_l, &clusters);
 
-			print("started directory service %i\n", c->id);	
+			print("started directory service %i (%i workers)\n", c->id, shards);
 		}
-		
-		resource_t *_r = resource_new_tlm(c->directory->tlm);
-		memcpy(_r, r, sizeof(resource_t));
-		_r->tlm = c->directory->tlm;
-		_r->type = tlm_strdup(_r->tlm, r->type);
 
-		view_add_resource(c->view, _r);
-		c->size++;
+		cluster_add_core(c, r);
 	}
 
 	pthread_mutex_init(&cluster_m, NULL);
@@ -166,13 +488,17 @@ view_t * cluster_unload() {
 	view_t *system = view_new();
 
 	for_each_entry_safe(cluster_t, c, _c, &clusters) {
-		agent_cleanup_thread(c->directory);
+		for (int j = 0; j < c->shards; j++) {
+			agent_cleanup_thread(c->workers[j].agent);
+		}
 
 		for_each_entry(resource_t, r, &c->view->resources) {
 			resource_t *_r = resource_new();
 			memcpy(_r, r, sizeof(resource_t));
 			_r->type = strdup(r->type);
 			_r->tlm = NULL;
+			_r->owner = c->owner[cluster_get_slot(r->index)];
+			_r->status = c->status[cluster_get_slot(r->index)];
 			if (distrm_is_idle_agent(_r->owner)) {
 				_r->status = RESOURCE_STATUS_FREE;
 			}
@@ -182,9 +508,22 @@ view_t * cluster_unload() {
 
 		list_del(&c->_l);
 
+		for (int j = 1; j < c->shards; j++) {
+			agent_free(c->workers[j].agent);
+		}
+
 		agent_free(c->directory);
 	}
 
+	free(core_cluster);
+	core_cluster = NULL;
+	free(core_slot);
+	core_slot = NULL;
+	free(core_tile);
+	core_tile = NULL;
+	free(density);
+	density = NULL;
+
 	pthread_mutex_destroy(&cluster_m);
 
 	return system;
@@ -202,7 +541,9 @@ void cluster_stop() {
 	shutdown = true;
 
 	for_each_entry_safe(cluster_t, c, _c, &clusters) {
-		agent_send(NULL, c->directory, distrm_message_new(NULL, DISTRM_END));
+		for (int j = 0; j < c->shards; j++) {
+			agent_send(NULL, c->workers[j].agent, distrm_message_new(NULL, DISTRM_END));
+		}
 	}
 
 	pthread_mutex_unlock(&cluster_m);
@@ -10,23 +10,48 @@
 #include "resource.h"
 #include "view.h"
 
+typedef struct directory {
+	struct cluster *cluster;
+	agent_t *agent;
+} directory_t;
+
+// owner and status of the cores of a cluster are held densely, indexed by slot
 typedef struct cluster {
 	struct list_head _l;
 	int id;
 	int size;
 	view_t *view;
+	int *owner;
+	int *status;
+	unsigned int *seq;
 	agent_t *directory;
+	int shards;
+	directory_t *workers;
 } cluster_t;
 
+void cluster_cache_new(distrm_agent_t *a);
+
+void cluster_cache_free(distrm_agent_t *a);
+
+void cluster_cache_update(distrm_agent_t *a, int index, agent_t *owner);
+
 agent_t * cluster_resolve_core(distrm_agent_t *a,  resource_t *r);
 
+void cluster_resolve_cores(distrm_agent_t *a, view_t *v, agent_t **owners);
+
 void cluster_register_core(distrm_agent_t *a, resource_t *r);
 
-int cluster_load(dcop_t *dcop, int size);
+void cluster_register_cores(distrm_agent_t *a, view_t *v);
+
+int cluster_load(dcop_t *dcop, int size, int shards, int lease);
 
 view_t * cluster_unload();
 
 void cluster_stop();
 
+int cluster_get_density(int tile);
+
+int cluster_get_available();
+
 #endif /* CLUSTER_H_ */
 
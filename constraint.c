@@ -48,6 +48,9 @@ void constraint_free(constraint_t *c) {
 		if (c->param.neighbors) {
 			tlm_free(c->tlm, c->param.neighbors);
 		}
+		if (c->delta.foreign) {
+			tlm_free(c->tlm, c->delta.foreign);
+		}
 		if (c->param.args) {
 			for (int i = 0; i < c->param.argc; i++) {
 				argument_free(&c->param.args[i]);
@@ -70,6 +73,45 @@ void register_native_constraint(const char *name, double (*eval)(struct constrai
 	print("registered native constraint '%s'\n", name);
 }
 
+void register_native_bound(const char *name, double (*bound)(struct constraint *)) {
+	for_each_entry(constraint_t, c, &native_constraints) {
+		if (!strcmp(c->name, name)) {
+			c->bound = bound;
+
+			return;
+		}
+	}
+
+	print_warning("failed to register bound for unknown native constraint '%s'\n", name);
+}
+
+void register_native_delta(const char *name, double (*reset)(struct constraint *), double (*update)(struct constraint *, resource_t *)) {
+	for_each_entry(constraint_t, c, &native_constraints) {
+		if (!strcmp(c->name, name)) {
+			c->reset = reset;
+			c->update = update;
+
+			return;
+		}
+	}
+
+	print_warning("failed to register delta evaluation for unknown native constraint '%s'\n", name);
+}
+
+bool constraint_supports_delta(constraint_t *c) {
+	if (c->type != CONSTRAINT_TYPE_NATIVE || !c->reset || !c->update) {
+		return false;
+	}
+
+	for (int i = 0; i < c->param.argc; i++) {
+		if (c->param.args[i].type == OBJECT_TYPE_CONSTRAINT && !constraint_supports_delta(c->param.args[i].constraint)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void free_native_constraints() {
 	for_each_entry_safe(constraint_t, c, _c, &native_constraints) {
 		list_del(&c->_l);
@@ -129,6 +171,9 @@ void constraint_load(agent_t *agent, constraint_t *c) {
 		if (!strcmp(c->name, _c->name)) {
 			c->type = CONSTRAINT_TYPE_NATIVE;
 			c->eval = _c->eval;
+			c->bound = _c->bound;
+			c->reset = _c->reset;
+			c->update = _c->update;
 		}
 	}
 	if (c->type == CONSTRAINT_TYPE_LUA) {
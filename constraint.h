@@ -1,6 +1,8 @@
 #ifndef CONSTRAINT_H_
 #define CONSTRAINT_H_
 
+#include <stdbool.h>
+
 #include <lua.h>
 
 #include "agent.h"
@@ -32,6 +34,13 @@ typedef struct parameter {
 	argument_t *args;
 } parameter_t;
 
+typedef struct constraint_delta {
+	int owned;
+	int conflicts;
+	int foreign_owned;
+	bool *foreign;
+} constraint_delta_t;
+
 typedef struct constraint {
 	struct list_head _l;
 	enum {
@@ -43,6 +52,10 @@ typedef struct constraint {
 	lua_State *L;
 	int ref;
 	double (*eval)(struct constraint *);
+	double (*bound)(struct constraint *);
+	double (*reset)(struct constraint *);
+	double (*update)(struct constraint *, resource_t *);
+	constraint_delta_t delta;
 	tlm_t *tlm;
 } constraint_t;
 
@@ -52,6 +65,12 @@ void constraint_free(constraint_t *c);
 
 void register_native_constraint(const char *name, double (*eval)(struct constraint *));
 
+void register_native_bound(const char *name, double (*bound)(struct constraint *));
+
+void register_native_delta(const char *name, double (*reset)(struct constraint *), double (*update)(struct constraint *, resource_t *));
+
+bool constraint_supports_delta(constraint_t *c);
+
 void free_native_constraints();
 
 double constraint_evaluate_lua(constraint_t *c);
@@ -8,6 +8,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -17,17 +19,23 @@
 
 #include "agent.h"
 #include "algorithm.h"
+#include "amgm.h"
+#include "barrier.h"
 #include "console.h"
 #include "constraint.h"
 #include "dcop.h"
 #include "distrm.h"
+#include "dpop.h"
+#include "dsa.h"
 #include "hardware.h"
 #include "list.h"
 #include "mgm.h"
+#include "mgm2.h"
 #include "native.h"
+#include "profile.h"
 #include "resource.h"
-
-#include <sim_api.h>
+#include "roi.h"
+#include "scheduler.h"
 
 static LIST_HEAD(algorithms);
 
@@ -51,6 +59,17 @@ static dcop_t *dcop = NULL;
 
 static char *tlm_stats_file = NULL;
 
+static char *profile_file = NULL;
+
+static char *service = NULL;
+
+static char *initial_file = NULL;
+static char *dump_file = NULL;
+
+// number of scheduler workers agents are multiplexed on, -1 runs one thread per agent
+static int fibers = -1;
+static bool deterministic = false;
+
 void dcop_register_algorithm(algorithm_t *a) {
 	list_add_tail(&a->_l, &algorithms);
 }
@@ -65,6 +84,10 @@ static algorithm_t * dcop_get_algorithm(const char *name) {
 
 static void dcop_init_algorithms() {
 	mgm_register();
+	mgm2_register();
+	amgm_register();
+	dsa_register();
+	dpop_register();
 	distrm_register();
 }
 
@@ -122,8 +145,8 @@ static void dcop_free(dcop_t *dcop) {
 			agent_free(a);
 		}
 
-		pthread_mutex_destroy(&dcop->mt);
-		pthread_cond_destroy(&dcop->cv);
+		barrier_free(dcop->roi_start);
+		barrier_free(dcop->roi_stop);
 
 		free(dcop);
 	}
@@ -141,6 +164,10 @@ static int __dcop_load(lua_State *L) {
 
 	dcop->L = L;
 
+	// agents may be attached to the specification later on (service mode)
+	lua_pushvalue(L, 1);
+	lua_setglobal(L, "__dcop");
+
 	print("loading hardware...\n");
 	dcop->hardware = (hardware_t *) calloc(1, sizeof(hardware_t));
 	lua_getfield(L, -1, "hardware");
@@ -207,6 +234,474 @@ static int __dcop_load_agent(lua_State *L) {
 	return 0;
 }
 
+static void dcop_grow_agent_views(dcop_t *dcop) {
+	// agent views are indexed by id, so every agent needs room for a new one
+	for_each_entry(agent_t, a, &dcop->agents) {
+		if (a->agent_view) {
+			view_t **agent_view = (view_t **) tlm_malloc(a->tlm, (dcop->number_of_agents + 1) * sizeof(view_t *));
+			memcpy(agent_view, a->agent_view, dcop->number_of_agents * sizeof(view_t *));
+
+			tlm_free(a->tlm, a->agent_view);
+			a->agent_view = agent_view;
+		}
+	}
+}
+
+static void dcop_release_resources(view_t *v, int id) {
+	for_each_entry(resource_t, r, &v->resources) {
+		if (resource_get_owner(r) == id) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+}
+
+static bool dcop_constraint_references(constraint_t *c, int id) {
+	for (int i = 0; i < c->param.number_of_neighbors; i++) {
+		if (c->param.neighbors[i] == id) {
+			return true;
+		}
+	}
+
+	for (int i = 0; i < c->param.argc; i++) {
+		if (c->param.args[i].type == OBJECT_TYPE_CONSTRAINT && dcop_constraint_references(c->param.args[i].constraint, id)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// constraints of x naming the departed agent a would rate a view that no longer exists
+static void dcop_drop_constraints(agent_t *x, agent_t *a) {
+	for_each_entry_safe(constraint_t, c, _c, &x->constraints) {
+		if (dcop_constraint_references(c, a->id)) {
+			list_del(&c->_l);
+			constraint_free(c);
+		}
+	}
+
+	if (x->L) {
+		lua_getglobal(x->L, "__agent");
+		lua_getfield(x->L, -1, "drop_neighbor");
+		lua_pushvalue(x->L, -2);
+		lua_pushnumber(x->L, a->id);
+		if (lua_pcall(x->L, 2, 0, 0)) {
+			print_error("failed to drop agent %i from agent %i (%s)\n", a->id, x->id, lua_tostring(x->L, -1));
+			lua_pop(x->L, 1);
+		}
+		lua_pop(x->L, 1);
+	}
+}
+
+static void dcop_detach_agent(dcop_t *dcop, agent_t *a) {
+	for_each_entry_safe(neighbor_t, n, _n, &a->neighbors) {
+		agent_t *x = n->agent;
+
+		for_each_entry_safe(neighbor_t, m, _m, &x->neighbors) {
+			if (m->agent == a) {
+				list_del(&m->_l);
+				neighbor_free(m);
+				x->number_of_neighbors--;
+			}
+		}
+
+		dcop_drop_constraints(x, a);
+
+		view_free(x->agent_view[a->id]);
+		x->agent_view[a->id] = NULL;
+
+		view_free(a->agent_view[x->id]);
+		a->agent_view[x->id] = NULL;
+
+		x->dirty = true;
+
+		list_del(&n->_l);
+		neighbor_free(n);
+	}
+	a->number_of_neighbors = 0;
+
+	for_each_entry(agent_t, x, &dcop->agents) {
+		dcop_release_resources(x->view, a->id);
+
+		for_each_entry(neighbor_t, n, &x->neighbors) {
+			dcop_release_resources(x->agent_view[n->agent->id], a->id);
+		}
+	}
+	dcop_release_resources(dcop->hardware->view, a->id);
+
+	for_each_entry_safe(constraint_t, c, _c, &a->constraints) {
+		list_del(&c->_l);
+		constraint_free(c);
+	}
+
+	if (a->L) {
+		lua_close(a->L);
+		a->L = NULL;
+	}
+
+	// rated by its empty list of native constraints
+	a->has_native_constraints = true;
+	a->has_lua_constraints = false;
+
+	a->vacant = true;
+
+	print("detached agent %i\n", a->id);
+}
+
+static int __dcop_attach(lua_State *L) {
+	lua_getglobal(L, "__this");
+	dcop_t *dcop = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if (!dcop) {
+		print_error("failed to retrieve '__this' userdata\n");
+
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	lua_getfield(L, 2, "id");
+	int id = lua_tonumber(L, -1);
+	lua_pop(L, 1);
+
+	// agents with lua constraints have a lua state of their own which doesn't know about attached agents
+	bool valid = true;
+	lua_getfield(L, 2, "neighbors");
+	int t = lua_gettop(L);
+	lua_pushnil(L);
+	while (lua_next(L, t)) {
+		agent_t *n = dcop_get_agent(dcop, lua_tonumber(L, -1));
+		if (!n || n->vacant || n->has_lua_constraints) {
+			valid = false;
+		}
+
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+
+	if (!valid) {
+		print_error("agent %i may only be attached to agents with native constraints\n", id);
+
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	agent_t *a = dcop_get_agent(dcop, id);
+	if (a) {
+		// the id of a departed agent is reused
+		view_free(a->view);
+		tlm_free(a->tlm, a->agent_view);
+		a->agent_view = NULL;
+	} else {
+		a = agent_new();
+		a->dcop = dcop;
+		a->id = id;
+		a->number_of_neighbors = 0;
+
+		list_add_tail(&a->_l, &dcop->agents);
+		dcop->number_of_agents++;
+
+		dcop_reset_ROI(dcop);
+
+		dcop_grow_agent_views(dcop);
+	}
+
+	lua_pushvalue(L, 2);
+
+	agent_load_neighbors(a);
+
+	a->L = L;
+	agent_load_view(a);
+	agent_load_agent_view(a);
+	agent_load_constraints(a);
+	a->L = NULL;
+
+	lua_pop(L, 1);
+
+	if (a->has_lua_constraints) {
+		print_error("agent %i may only have native constraints\n", id);
+
+		dcop_detach_agent(dcop, a);
+
+		lua_pushboolean(L, false);
+		return 1;
+	}
+
+	a->has_native_constraints = true;
+
+	for_each_entry(neighbor_t, n, &a->neighbors) {
+		view_t *v = view_clone(a->view);
+		view_clear(v);
+
+		n->agent->agent_view[a->id] = v;
+		n->agent->dirty = true;
+	}
+
+	a->vacant = false;
+	a->dirty = true;
+
+	print("attached agent %i\n", a->id);
+
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+// every agent is authoritative for the resources it owns
+static void dcop_sync_views(dcop_t *dcop) {
+	view_t *v = dcop->hardware->view;
+
+	resource_t *resources[dcop->hardware->number_of_resources];
+	for_each_entry(resource_t, r, &v->resources) {
+		r->status = RESOURCE_STATUS_FREE;
+		resources[r->index] = r;
+	}
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		for_each_entry(resource_t, r, &a->view->resources) {
+			if (agent_is_owner(a, r)) {
+				agent_claim_resource(a, resources[r->index]);
+			}
+		}
+	}
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		view_copy(a->view, v);
+	}
+
+	dcop_refresh(dcop);
+}
+
+// reads lines of 'index owner' (-1 for free resources) as dumped by dcop_dump_assignment
+static int dcop_load_assignment(dcop_t *dcop, const char *file) {
+	FILE *f = fopen(file, "r");
+	if (!f) {
+		return -1;
+	}
+
+	view_t *v = dcop->hardware->view;
+
+	resource_t *resources[dcop->hardware->number_of_resources];
+	for_each_entry(resource_t, r, &v->resources) {
+		resources[r->index] = r;
+	}
+
+	int index, owner;
+	while (fscanf(f, "%i %i", &index, &owner) == 2) {
+		if (index < 0 || index >= dcop->hardware->number_of_resources) {
+			print_warning("ignoring unknown resource %i in '%s'\n", index, file);
+			continue;
+		}
+
+		resource_t *r = resources[index];
+
+		agent_t *a = owner < 0 ? NULL : dcop_get_agent(dcop, owner);
+		if (owner >= 0 && !a) {
+			print_warning("ignoring unknown owner %i of resource %i in '%s'\n", owner, index, file);
+			continue;
+		}
+
+		if (a) {
+			agent_claim_resource(a, r);
+		} else {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+
+	fclose(f);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		view_copy(a->view, v);
+	}
+
+	dcop_refresh(dcop);
+
+	return 0;
+}
+
+static void dcop_dump_assignment(dcop_t *dcop, const char *file) {
+	FILE *f = fopen(file, "w");
+	if (!f) {
+		print_warning("failed to open assignment file '%s'\n", file);
+		return;
+	}
+
+	for_each_entry(resource_t, r, &dcop->hardware->view->resources) {
+		fprintf(f, "%i %i\n", r->index, r->status == RESOURCE_STATUS_TAKEN ? resource_get_owner(r) : -1);
+	}
+
+	fclose(f);
+}
+
+/*
+ * returns the time in ms the algorithm took to repair the assignment
+ *
+ * The algorithms run over all agents: barriers and message routing are sized
+ * by agent ids, so the affected neighbourhoods cannot be cut out. Every agent
+ * starts from the current assignment though, so only dirty agents and their
+ * neighbours have anything to repair.
+ */
+static double dcop_solve(dcop_t *dcop) {
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	algo->init(dcop, algorithm_argc, algorithm_argv);
+	algo->run(dcop);
+	algo->cleanup(dcop);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	dcop_sync_views(dcop);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		a->dirty = false;
+	}
+
+	return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+static FILE * dcop_open_service(int *fd) {
+	if (!strcmp(service, "-")) {
+		return stdin;
+	}
+
+	if (strncmp(service, "unix:", 5)) {
+		return fopen(service, "r");
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, service + 5, sizeof(addr.sun_path) - 1);
+
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) {
+		return NULL;
+	}
+
+	unlink(addr.sun_path);
+
+	if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) || listen(s, 1)) {
+		close(s);
+		return NULL;
+	}
+
+	print("waiting for connection on '%s'\n", addr.sun_path);
+
+	*fd = accept(s, NULL, NULL);
+
+	close(s);
+
+	return *fd < 0 ? NULL : fdopen(*fd, "r");
+}
+
+static void dcop_reply(int fd, const char *f, double latency) {
+	if (fd >= 0) {
+		dprintf(fd, f, latency);
+	}
+}
+
+/*
+ * service mode: commands are read line by line, agents arriving or departing
+ * are repaired from the current assignment
+ *
+ * add SCRIPT    run SCRIPT, which attaches agents using __dcop:attach(agent)
+ * remove ID     detach agent ID and release its resources
+ * solve         repair the current assignment
+ * dump          print the current assignment
+ * quit          leave service mode
+ */
+static void dcop_service(dcop_t *dcop) {
+	int fd = -1;
+
+	FILE *f = dcop_open_service(&fd);
+	if (!f) {
+		print_error("failed to open command stream '%s'\n", service);
+		return;
+	}
+
+	lua_register(dcop->L, "__dcop_attach", __dcop_attach);
+
+	dcop_sync_views(dcop);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		a->dirty = false;
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		char *cmd = strtok(line, " \t\r\n");
+		char *arg = strtok(NULL, " \t\r\n");
+
+		if (!cmd || cmd[0] == '#') {
+			continue;
+		}
+
+		double latency;
+
+		if (!strcmp(cmd, "add") && arg) {
+			if (luaL_dofile(dcop->L, arg)) {
+				print_error("failed to load '%s': %s\n", arg, lua_tostring(dcop->L, -1));
+				lua_pop(dcop->L, 1);
+
+				dcop_reply(fd, "error\n", 0);
+				continue;
+			}
+
+			latency = dcop_solve(dcop);
+			print("repair after arrival took %f ms\n", latency);
+		} else if (!strcmp(cmd, "remove") && arg) {
+			agent_t *a = dcop_get_agent(dcop, strtol(arg, NULL, 10));
+			if (!a || a->vacant) {
+				print_error("unknown agent '%s'\n", arg);
+
+				dcop_reply(fd, "error\n", 0);
+				continue;
+			}
+
+			int id = a->id;
+
+			dcop_detach_agent(dcop, a);
+
+			lua_getglobal(dcop->L, "__dcop");
+			lua_getfield(dcop->L, -1, "detach");
+			lua_pushvalue(dcop->L, -2);
+			lua_pushnumber(dcop->L, id);
+			if (lua_pcall(dcop->L, 2, 0, 0)) {
+				print_error("failed to detach agent %i (%s)\n", id, lua_tostring(dcop->L, -1));
+				lua_pop(dcop->L, 1);
+			}
+			lua_pop(dcop->L, 1);
+
+			latency = dcop_solve(dcop);
+			print("repair after departure took %f ms\n", latency);
+		} else if (!strcmp(cmd, "solve")) {
+			for_each_entry(agent_t, a, &dcop->agents) {
+				a->dirty = true;
+			}
+
+			latency = dcop_solve(dcop);
+			print("solving took %f ms\n", latency);
+		} else if (!strcmp(cmd, "dump")) {
+			view_dump(dcop->hardware->view);
+			latency = 0;
+		} else if (!strcmp(cmd, "quit")) {
+			dcop_reply(fd, "ok\n", 0);
+			break;
+		} else {
+			print_error("unknown command '%s'\n", cmd);
+
+			dcop_reply(fd, "error\n", 0);
+			continue;
+		}
+
+		dcop_reply(fd, "ok %f\n", latency);
+	}
+
+	if (f != stdin) {
+		fclose(f);
+	}
+}
+
 static lua_State * dcop_create_lua_state(void *object, const char *file, int (*load)(lua_State *), int argc, char **argv) {
 	lua_State *L = luaL_newstate();
 	if (!L) {
@@ -285,9 +780,7 @@ static struct dcop * dcop_load(const char *file, int argc, char **argv) {
 
 	}
 
-	pthread_mutex_init(&dcop->mt, NULL);
-	pthread_cond_init(&dcop->cv, NULL);
-	dcop->ready = 0;
+	dcop_reset_ROI(dcop);
 
 	return dcop;
 }
@@ -296,6 +789,10 @@ int dcop_get_number_of_cores() {
 	return sysconf(_SC_NPROCESSORS_ONLN);
 }
 
+time_t dcop_get_seed() {
+	return r_seed;
+}
+
 void * dcop_malloc_aligned(size_t size) {
 	void *p;
 	posix_memalign(&p, sysconf(_SC_PAGE_SIZE), size);
@@ -304,38 +801,57 @@ void * dcop_malloc_aligned(size_t size) {
 	return p;
 }
 
-void dcop_start_ROI(dcop_t *dcop) {
-	pthread_mutex_lock(&dcop->mt);
+static void dcop_roi_start(void *arg) {
+	dcop_t *dcop = (dcop_t *) arg;
 
-	if (++dcop->ready == dcop->number_of_agents) {
-		SimRoiStart();
+	roi_begin();
 
-		pthread_cond_broadcast(&dcop->cv);
-	} else {
-		pthread_cond_wait(&dcop->cv, &dcop->mt);
-	}
+	dcop->roi = true;
+}
 
-	pthread_mutex_unlock(&dcop->mt);
+static void dcop_roi_end(void *arg) {
+	dcop_t *dcop = (dcop_t *) arg;
+
+	roi_end();
+
+	dcop->roi = false;
 }
 
-void dcop_stop_ROI(dcop_t *dcop) {
-	pthread_mutex_lock(&dcop->mt);
+// the ROI barriers are sized to the number of agents
+void dcop_reset_ROI(dcop_t *dcop) {
+	barrier_free(dcop->roi_start);
+	barrier_free(dcop->roi_stop);
+
+	dcop->roi_start = barrier_new(dcop->number_of_agents, dcop_roi_start, dcop);
+	dcop->roi_stop = barrier_new(dcop->number_of_agents, dcop_roi_end, dcop);
+	dcop->roi = false;
+
+	roi_init(dcop->number_of_agents);
+}
 
-	if (dcop->ready == 0) {
-		pthread_mutex_unlock(&dcop->mt);
+void dcop_start_ROI(agent_t *a) {
+	PROFILE_BEGIN(t);
+
+	barrier_wait(a->dcop->roi_start, a->id - 1);
+
+	PROFILE_END(a->profile[PROFILE_BARRIER_WAIT], t);
+
+	roi_thread_begin(a->id);
+}
 
+void dcop_stop_ROI(agent_t *a) {
+	// every agent of the episode passes this before the ROI ends
+	if (!__atomic_load_n(&a->dcop->roi, __ATOMIC_ACQUIRE)) {
 		return;
 	}
 
-	if (--dcop->ready == 0) {
-		SimRoiEnd();
+	roi_thread_end(a->id);
 
-		pthread_cond_broadcast(&dcop->cv);
-	} else {
-		pthread_cond_wait(&dcop->cv, &dcop->mt);
-	}
+	PROFILE_BEGIN(t);
 
-	pthread_mutex_unlock(&dcop->mt);
+	barrier_wait(a->dcop->roi_stop, a->id - 1);
+
+	PROFILE_END(a->profile[PROFILE_BARRIER_WAIT], t);
 }
 
 static void dcop_dump_tlm_stats(dcop_t *dcop) {
@@ -354,6 +870,48 @@ static void dcop_dump_tlm_stats(dcop_t *dcop) {
 	fclose(f);
 }
 
+// one line per agent: id followed by the cycles spent in each phase
+static void dcop_dump_profile(dcop_t *dcop) {
+	if (!profile_file) {
+		return;
+	}
+
+#ifdef DCOP_PROFILE
+	print("dumping phase profile\n");
+
+	FILE *f = fopen(profile_file, "w");
+	if (!f) {
+		print_warning("failed to open profile file '%s'\n", profile_file);
+		return;
+	}
+
+	const char *phases[] = PROFILE_PHASE_NAMES;
+
+	fprintf(f, "# agent");
+	for (int i = 0; i < PROFILE_PHASES; i++) {
+		fprintf(f, " %s", phases[i]);
+	}
+	fprintf(f, "\n");
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		// allocations are accounted to the TLM of the agent
+		if (a->tlm) {
+			a->profile[PROFILE_ALLOC] = a->tlm->alloc_cycles;
+		}
+
+		fprintf(f, "%i", a->id);
+		for (int i = 0; i < PROFILE_PHASES; i++) {
+			fprintf(f, " %llu", a->profile[i]);
+		}
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+#else
+	print_warning("profiling not compiled in (build with PROFILE=1)\n");
+#endif
+}
+
 static void usage() {
 	printf("\n");
 	printf("usage:\n");
@@ -397,6 +955,24 @@ static void usage() {
 	printf("	--tlmstats FILE, -t FILE\n");
 	printf("		dump tlm statistics to FILE\n");
 	printf("\n");
+	printf("	--profile FILE, -P FILE\n");
+	printf("		dump per agent phase timings to FILE (requires a build with PROFILE=1)\n");
+	printf("\n");
+	printf("	--initial FILE, -i FILE\n");
+	printf("		start from the resource assignment in FILE\n");
+	printf("\n");
+	printf("	--dump FILE, -w FILE\n");
+	printf("		dump final resource assignment to FILE\n");
+	printf("\n");
+	printf("	--fibers WORKERS, -F WORKERS\n");
+	printf("		run agents as coroutines on WORKERS threads (0 for one per core)\n");
+	printf("\n");
+	printf("	--deterministic , -D\n");
+	printf("		run all agents on the main thread in a reproducible order (depends on --seed only)\n");
+	printf("\n");
+	printf("	--service FILE, -S FILE\n");
+	printf("		keep running and read commands from FILE (- for stdin, unix:PATH for a socket)\n");
+	printf("\n");
 
 	printf("algorithms:\n");
 	printf("\n");
@@ -421,11 +997,17 @@ static int parse_arguments(int argc, char **argv) {
 		{ "shared", no_argument, NULL, 'm' },
 		{ "quiet", no_argument, NULL, 'q' },
 		{ "tlmstats", required_argument, NULL, 't'},
+		{ "profile", required_argument, NULL, 'P'},
+		{ "service", required_argument, NULL, 'S'},
+		{ "initial", required_argument, NULL, 'i'},
+		{ "dump", required_argument, NULL, 'w'},
+		{ "fibers", required_argument, NULL, 'F'},
+		{ "deterministic", no_argument, NULL, 'D'},
 		{ 0 }
 	};
 
 	while (true) {
-		int result = getopt_long(argc, argv, "ha:l:dp:o:f:s:emqt:", long_options, NULL);
+		int result = getopt_long(argc, argv, "ha:l:dp:o:f:s:emqt:P:S:i:w:F:D", long_options, NULL);
 		if (result == -1) {
 			break;
 		}
@@ -490,6 +1072,41 @@ static int parse_arguments(int argc, char **argv) {
 				tlm_stats_file = strdup(optarg);
 				break;
 
+			case 'P':
+				printf("dumping phase profile to %s\n", optarg);
+				profile_file = strdup(optarg);
+				break;
+
+			case 'S':
+				printf("running in service mode, reading commands from %s\n", optarg);
+				service = strdup(optarg);
+				break;
+
+			case 'i':
+				printf("starting from resource assignment in %s\n", optarg);
+				initial_file = strdup(optarg);
+				break;
+
+			case 'w':
+				printf("dumping final resource assignment to %s\n", optarg);
+				dump_file = strdup(optarg);
+				break;
+
+			case 'F':
+				fibers = strtol(optarg, NULL, 10);
+				if (fibers < 0) {
+					printf("invalid number of workers given\n");
+					fibers = -1;
+				} else {
+					printf("running agents as fibers\n");
+				}
+				break;
+
+			case 'D':
+				printf("running agents deterministically\n");
+				deterministic = true;
+				break;
+
 			case '?':
 			case ':':
 			default:
@@ -595,7 +1212,24 @@ int main(int argc, char **argv) {
 	}
 	print("completed loading '%s'\n", spec);
 
-	if (dcop->number_of_agents > dcop_get_number_of_cores()) {
+	if (initial_file) {
+		print("loading initial resource assignment from '%s'\n", initial_file);
+		if (dcop_load_assignment(dcop, initial_file)) {
+			print_error("failed to load resource assignment from '%s'\n", initial_file);
+			status = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	if (deterministic) {
+		scheduler_start_deterministic();
+	} else if (fibers >= 0) {
+		if (scheduler_start(fibers)) {
+			print_error("failed to start scheduler\n");
+			status = EXIT_FAILURE;
+			goto cleanup;
+		}
+	} else if (dcop->number_of_agents > dcop_get_number_of_cores()) {
 		print_warning("number of agents exceeds available physical cores\n");
 	}
 
@@ -623,6 +1257,11 @@ int main(int argc, char **argv) {
 	algo->cleanup(dcop);
 	print("algorithm '%s' finished\n", algo->name);
 
+	barrier_print_stats(dcop->roi_start, "ROI start");
+	barrier_print_stats(dcop->roi_stop, "ROI stop");
+
+	roi_print_stats();
+
 	//SimRoiEnd();
 
 	print("\nprevious resource assignment (%lX):\n", r_seed);
@@ -636,8 +1275,25 @@ int main(int argc, char **argv) {
 	print("final resource assignment:\n");
 	view_dump(dcop->hardware->view);
 
+	if (service) {
+		print("\nentering service mode\n");
+		dcop_service(dcop);
+
+		print("\nresource assignment after service mode:\n");
+		view_dump(dcop->hardware->view);
+	}
+
+	if (dump_file) {
+		print("dumping final resource assignment to '%s'\n", dump_file);
+		dcop_dump_assignment(dcop, dump_file);
+	}
+
 	dcop_dump_tlm_stats(dcop);
 
+	dcop_dump_profile(dcop);
+
+	scheduler_stop();
+
 	dcop_free(dcop);
 
 	free_native_constraints();
@@ -660,6 +1316,18 @@ cleanup:
 	if (r_seedfile) {
 		free(r_seedfile);
 	}
+	if (service) {
+		free(service);
+	}
+	if (initial_file) {
+		free(initial_file);
+	}
+	if (dump_file) {
+		free(dump_file);
+	}
+	if (profile_file) {
+		free(profile_file);
+	}
 
 	exit(status);
 }
@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <lua.h>
 
@@ -10,6 +11,7 @@ typedef struct dcop dcop_t;
 
 #include "agent.h"
 #include "algorithm.h"
+#include "barrier.h"
 #include "hardware.h"
 #include "list.h"
 
@@ -18,9 +20,9 @@ struct dcop {
 	hardware_t *hardware;
 	int number_of_agents;
 	struct list_head agents;
-	pthread_mutex_t mt;
-	pthread_cond_t cv;
-	int ready;
+	barrier_t *roi_start;
+	barrier_t *roi_stop;
+	bool roi;
 };
 
 extern bool skip_lua;
@@ -41,11 +43,15 @@ void dcop_merge_view(dcop_t *dcop);
 
 int dcop_get_number_of_cores();
 
+time_t dcop_get_seed();
+
 void * dcop_malloc_aligned(size_t size);
 
-void dcop_start_ROI(dcop_t *dcop);
+void dcop_reset_ROI(dcop_t *dcop);
+
+void dcop_start_ROI(struct agent *a);
 
-void dcop_stop_ROI(dcop_t *dcop);
+void dcop_stop_ROI(struct agent *a);
 
 #endif /* DCOP_H_ */
 
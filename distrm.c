@@ -11,12 +11,14 @@
 
 #include "agent.h"
 #include "algorithm.h"
+#include "barrier.h"
 #include "cluster.h"
 #include "console.h"
 #include "dcop.h"
 #include "distrm.h"
 #include "list.h"
 #include "native.h"
+#include "profile.h"
 #include "region.h"
 #include "resource.h"
 #include "tlm.h"
@@ -34,18 +36,48 @@ static int max_dist = 2;
 static int locality_thresh = 1;
 static int size_thresh = 5;
 static int max_rounds = 20;
+static int lease = 1;
+static int shards = 1;
+static int concurrent = 1;
+static double stream_gain = -1;
+static bool select_density = false;
 
 static int rounds = 0;
-static int ready = 0;
 
 static bool stale = false;
 
 static distrm_agent_t *idle_agent = NULL;
+// known before the idle agent exists, the directories already need it while loading
+static int idle_id = 0;
 
-static distrm_agent_t *invading_agent = NULL;
+// invaders chosen for the next round, invaders of the current round and those still running
+static int invaders = 0;
+static int round_invaders = 0;
+static int active = 0;
+static bool progress = false;
+
+static unsigned long invasions = 0;
+static unsigned long successful = 0;
+static unsigned long conflicts = 0;
+
+// tries whose regions offered no core at all
+static unsigned long probes = 0;
+static unsigned long wasted = 0;
+
+static unsigned long long hold_ns = 0;
+static unsigned long holds = 0;
+static unsigned long long latency_ns = 0;
 
 static pthread_mutex_t distrm_m;
-static pthread_cond_t distrm_cv;
+
+static barrier_t *round_barrier = NULL;
+
+static unsigned long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
 
 #define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
 
@@ -71,6 +103,18 @@ void distrm_message_free(tlm_t *tlm, void *buf) {
 				tlm_free(tlm, msg->core);
 				break;
 
+			case DISTRM_INFO_BATCH:
+				if (msg->owners) {
+					tlm_free(tlm, msg->owners);
+				}
+				// fall through
+			case DISTRM_REGISTER_BATCH:
+			case DISTRM_LOCATE_BATCH:
+				if (msg->cores) {
+					tlm_free(tlm, msg->cores);
+				}
+				break;
+
 			default:
 				break;
 		}
@@ -89,37 +133,110 @@ message_t * distrm_message_new(tlm_t *tlm, int type) {
 	return m;
 }
 
+// run by the last agent arriving at the round barrier
+static void distrm_next_round(void *unused) {
+	round_invaders = invaders < concurrent ? invaders : concurrent;
+	active = round_invaders;
+	invaders = 0;
+	progress = false;
+
+	rounds++;
+}
+
 static bool distrm_invade(distrm_agent_t *a) {
 	bool invading = false;
 
+	if (a->rounds < max_rounds && (!a->was_invading || rounds >= max_rounds * (a->agent->dcop->number_of_agents - 1)) && !a->stale) {
+		invading = (__atomic_fetch_add(&invaders, 1, __ATOMIC_RELAXED) < concurrent);
+	}
+
+	PROFILE_BEGIN(t);
+
+	barrier_wait(round_barrier, a->agent->id - 1);
+
+	PROFILE_END(a->agent->profile[PROFILE_BARRIER_WAIT], t);
+
+	return invading;
+}
+
+// returns true if a was the last invader of the round to finish
+static bool distrm_finish(distrm_agent_t *a, int taken) {
 	pthread_mutex_lock(&distrm_m);
 
-	if (!invading_agent && a->rounds < max_rounds && (!a->was_invading || rounds >= max_rounds * (a->agent->dcop->number_of_agents - 1)) && !a->stale) {
-		invading_agent = a;
+	invasions++;
 
-		invading = true;
+	if (taken > 0) {
+		successful++;
+		progress = true;
 	}
-	
-	if (++ready == a->agent->dcop->number_of_agents) {
-		pthread_cond_broadcast(&distrm_cv);
 
-		rounds++;
-	} else {
-		pthread_cond_wait(&distrm_cv, &distrm_m);
+	bool last = (--active == 0);
+	if (last) {
+		stale = !progress;
 	}
 
 	pthread_mutex_unlock(&distrm_m);
 
-	return invading;
+	return last;
 }
 
-#define distrm_is_invading(a) (a == invading_agent)
+int distrm_get_round() {
+	return rounds;
+}
 
 bool distrm_is_idle_agent(int id) {
-	return (idle_agent->agent->id == id);
+	return (idle_id == id);
+}
+
+// picks a tile proportional to its number of free cores, then a core of that tile
+static resource_t * distrm_get_dense_core(distrm_agent_t *a) {
+	int total = cluster_get_available();
+	if (total <= 0) {
+		return NULL;
+	}
+
+	int n;
+	random_r(&a->buf, &n);
+	n %= total;
+
+	int tile;
+	for (tile = 1; tile < a->agent->dcop->hardware->number_of_tiles; tile++) {
+		n -= cluster_get_density(tile);
+		if (n < 0) {
+			break;
+		}
+	}
+
+	int cores = 0;
+	for_each_entry(resource_t, r, &a->agent->view->resources) {
+		if (r->tile == tile) {
+			cores++;
+		}
+	}
+	if (cores == 0) {
+		return NULL;
+	}
+
+	random_r(&a->buf, &n);
+	n %= cores;
+
+	for_each_entry(resource_t, r, &a->agent->view->resources) {
+		if (r->tile == tile && n-- == 0) {
+			return resource_clone(r);
+		}
+	}
+
+	return NULL;
 }
 
 resource_t * distrm_get_random_core(distrm_agent_t *a) {
+	if (select_density) {
+		resource_t *r = distrm_get_dense_core(a);
+		if (r) {
+			return r;
+		}
+	}
+
 	int index;
 	random_r(&a->buf, &index);
 	index %= a->agent->dcop->hardware->number_of_resources;
@@ -134,34 +251,32 @@ static double random_d(distrm_agent_t *a) {
 	return (double) i / RAND_MAX;
 }
 
-static double speedup(distrm_agent_t *a, view_t *v) {
-	return _downey(a->A, a->sigma, v->size);
-}
+// speedup only depends on the number of cores, a->speedups holds it for all counts
+#define speedup_n(a, n) ((a)->speedups[n])
 
-static double speedup_with_core(distrm_agent_t *a, view_t *v, resource_t *r) {
-	resource_t *_r = resource_clone(r);
-	view_add_resource(v, _r);
+static void init_speedups(distrm_agent_t *a) {
+	int n = a->agent->dcop->hardware->number_of_resources + 2;
 
-	double s = speedup(a, v);
+	a->speedups = tlm_malloc(a->agent->tlm, n * sizeof(double));
 
-	view_del_resource(v, _r);
-	resource_free(_r);
-
-	return s;
+	for (int i = 0; i < n; i++) {
+		a->speedups[i] = _downey(a->A, a->sigma, i);
+	}
 }
 
-static double speedup_without_core(distrm_agent_t *a, view_t *v, resource_t *r) {
-	view_t *_v = view_clone(v);
-
-	resource_t *_r = view_get_resource(_v, r->index);
-	view_del_resource(_v, _r);
-	resource_free(_r);
-
-	double s = speedup(a, _v);
+static void reserve_cores(distrm_agent_t *a, view_t *offered_cores) {
+	view_cut(a->owned_cores, offered_cores);
+	view_concat(a->reserved_cores, offered_cores);
 
-	view_free(_v);
+	unsigned long long t = now_ns();
+	for_each_entry(resource_t, r, &offered_cores->resources) {
+		a->reserved_at[r->index] = t;
+	}
+}
 
-	return s;
+static void release_core(distrm_agent_t *a, int index) {
+	__atomic_add_fetch(&hold_ns, now_ns() - a->reserved_at[index], __ATOMIC_RELAXED);
+	__atomic_add_fetch(&holds, 1, __ATOMIC_RELAXED);
 }
 
 static view_t * create_offer(distrm_agent_t *a, distrm_agent_t *c, region_t *region) {
@@ -170,63 +285,55 @@ static view_t * create_offer(distrm_agent_t *a, distrm_agent_t *c, region_t *reg
 	if (distrm_is_idle_agent(a->agent->id)) {
 		view_concat(offered_cores, a->owned_cores);
 
-		view_cut(a->owned_cores, offered_cores);
-		view_concat(a->reserved_cores, offered_cores);
+		if (concurrent == 1) {
+			reserve_cores(a, offered_cores);
+		}
 
 		return offered_cores;
 	}
 
-	view_t *potential_cores = view_clone(a->owned_cores);
-	for_each_entry_safe(resource_t, r, _r, &potential_cores->resources) {
-		if (!region_contains(region, r)) {
-			view_del_resource(potential_cores, r);
-			resource_free(r);
+	int potential_cores = 0;
+	for_each_entry(resource_t, r, &a->owned_cores->resources) {
+		if (region_contains(region, r)) {
+			potential_cores++;
 		}
 	}
-	double share_giver = (double) potential_cores->size / region->view->size;
-
-	view_t *cores_receiver = view_clone(c->owned_cores);
-	view_t *cores_giver = view_clone(a->owned_cores);
-
-	double gain_total = INFINITY;
-	while (gain_total > 0) {
-		gain_total = 0;
-
-		view_t *greedy_choice = view_new_tlm(a->agent->tlm);
-
-		double base_receiver = speedup(c, cores_receiver);
-		double base_giver = speedup(a, cores_giver);
-
-		for_each_entry_safe(resource_t, r, __r, &potential_cores->resources) {
-			double gain_receiver = share_giver * speedup_with_core(c, cores_receiver, r) - base_receiver;
-			double loss_giver = base_giver - speedup_without_core(a, cores_giver, r);
-
-			if (gain_receiver - loss_giver > gain_total) {
-				view_add_resource(greedy_choice, resource_clone(r));
-
-				gain_total = gain_receiver - loss_giver;
-			}
+	double share_giver = (double) potential_cores / region->view->size;
+
+	int cores_receiver = c->owned_cores->size;
+	int cores_giver = a->owned_cores->size;
+
+	/*
+	 * Every greedy step offers one more core as long as the receiver's share
+	 * of the gain outweighs the giver's loss. Both only depend on counts, so
+	 * the offer consists of the first k potential cores.
+	 */
+	int k = 0;
+	while (k < potential_cores) {
+		double gain_receiver = share_giver * speedup_n(c, cores_receiver + k + 1) - speedup_n(c, cores_receiver + k);
+		double loss_giver = speedup_n(a, cores_giver - k) - speedup_n(a, cores_giver - k - 1);
+
+		if (gain_receiver - loss_giver <= 0) {
+			break;
 		}
 
-		if (gain_total > 0) {
-			view_concat(offered_cores, greedy_choice);
-
-			view_cut(potential_cores, offered_cores);
+		k++;
+	}
 
-			view_concat(cores_receiver, offered_cores);
-			view_cut(cores_giver, offered_cores);
+	for_each_entry(resource_t, r, &a->owned_cores->resources) {
+		if (offered_cores->size == k) {
+			break;
 		}
 
-		view_free(greedy_choice);
+		if (region_contains(region, r)) {
+			view_add_resource(offered_cores, resource_clone(r));
+		}
 	}
 
-	view_free(cores_giver);
-	view_free(cores_receiver);
-
-	view_free(potential_cores);
-
-	view_cut(a->owned_cores, offered_cores);
-	view_concat(a->reserved_cores, offered_cores);
+	// concurrent invasions are optimistic, offered cores stay owned until an ACCEPT is confirmed
+	if (concurrent == 1) {
+		reserve_cores(a, offered_cores);
+	}
 
 	return offered_cores;
 }
@@ -235,30 +342,48 @@ agent_t * distrm_get_agent(dcop_t *dcop, int id) {
 	return (!distrm_is_idle_agent(id) ? dcop_get_agent(dcop, id) : idle_agent->agent);
 }
 
-static void send_request(distrm_agent_t *a, region_t *region) {
-	message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REQUEST);
-	distrm_message(msg)->region = region;
-	distrm_message(msg)->from = a;
+static distrm_pending_t * pending_new(distrm_agent_t *a, int type) {
+	distrm_pending_t *p = (distrm_pending_t *) tlm_malloc(a->agent->tlm, sizeof(distrm_pending_t));
+
+	p->id = a->next_request++;
+	p->type = type;
+	p->offer = view_new_tlm(a->agent->tlm);
 
-	agent_t *handler = cluster_resolve_core(a, region->center);
+	list_add_tail(&p->_l, &a->pending);
 
-	agent_send(a->agent, handler, msg);
+	return p;
 }
 
-static bool filter_distrm_offer(message_t *msg, void *unused) {
-	if (distrm_message(msg)->type == DISTRM_END) {
-		return true;
+static distrm_pending_t * pending_get(distrm_agent_t *a, int id) {
+	for_each_entry(distrm_pending_t, p, &a->pending) {
+		if (p->id == id) {
+			return p;
+		}
 	}
 
-	if (distrm_message(msg)->type == DISTRM_MAKE_OFFER) {
-		return true;
+	return NULL;
+}
+
+static void pending_free(distrm_agent_t *a, distrm_pending_t *p) {
+	list_del(&p->_l);
+
+	if (p->offer) {
+		view_free(p->offer);
+	}
+	if (p->accepted) {
+		view_free(p->accepted);
 	}
 
-	return (distrm_message(msg)->type == DISTRM_OFFER);
+	region_free_all(a, p->subregions);
+	region_free_all(a, p->regions);
+
+	tlm_free(a->agent->tlm, p);
 }
 
 static void handle_make_offer(distrm_agent_t *a, message_t *msg) {
 	message_t *offer = distrm_message_new(a->agent->tlm, DISTRM_OFFER);
+	distrm_message(offer)->from = distrm_message(msg)->from;
+	distrm_message(offer)->request = distrm_message(msg)->request;
 
 	distrm_message(offer)->offer = view_new_tlm(a->agent->tlm);
 
@@ -273,51 +398,67 @@ static void handle_make_offer(distrm_agent_t *a, message_t *msg) {
 	DEBUG_MESSAGE(a, "sent offer to managing agent %i\n", msg->from->id);
 }
 
-static void handle_request(distrm_agent_t *a, message_t *msg) {
+// all neighbors made their offers, answer the invader
+static void handler_complete(distrm_agent_t *a, distrm_pending_t *p) {
 	message_t *response = distrm_message_new(a->agent->tlm, DISTRM_OFFER);
+	distrm_message(response)->from = p->from;
+	distrm_message(response)->request = p->request;
+
+	distrm_message(response)->offer = p->offer;
+	p->offer = NULL;
 
-	distrm_message(response)->offer = view_new_tlm(a->agent->tlm);
+	if (a != p->from) {
+		view_concat(distrm_message(response)->offer, create_offer(a, p->from, p->region));
+	}
+
+	DEBUG_MESSAGE(a, "sending a response to %i\n", p->from->agent->id);
+	agent_send(a->agent, p->from->agent, response);
+
+	pending_free(a, p);
+}
+
+static void handle_request(distrm_agent_t *a, message_t *msg) {
+	distrm_pending_t *p = pending_new(a, DISTRM_PENDING_HANDLER);
+	p->from = distrm_message(msg)->from;
+	p->region = distrm_message(msg)->region;
+	p->request = distrm_message(msg)->request;
+	p->remaining = distrm_message(msg)->num_neighbors;
 
 	for (int i = 0; i < distrm_message(msg)->num_neighbors; i++) {
 		message_t *forward = distrm_message_new(a->agent->tlm, DISTRM_MAKE_OFFER);
 		distrm_message(forward)->region = distrm_message(msg)->region;
 		distrm_message(forward)->from = distrm_message(msg)->from;
+		distrm_message(forward)->request = p->id;
 
 		agent_send(a->agent, distrm_message(msg)->neighbors[i], forward);	
 	}
 
-	for (int i = 0; i < distrm_message(msg)->num_neighbors; i++) {
-		message_t *remote_offer =  agent_recv_filter(a->agent, filter_distrm_offer, NULL);
-
-		if (distrm_message(remote_offer)->type != DISTRM_OFFER) {
-			handle_make_offer(a, remote_offer);
-			i--;
-		} else {
-			view_concat(distrm_message(response)->offer, distrm_message(remote_offer)->offer);
-		}
-
-		message_free(remote_offer);
-	}
-
-	if (a != distrm_message(msg)->from) {
-		view_concat(distrm_message(response)->offer, create_offer(a, distrm_message(msg)->from, distrm_message(msg)->region));
+	if (p->remaining == 0) {
+		handler_complete(a, p);
 	}
-
-	DEBUG_MESSAGE(a, "sending a response to %i\n", distrm_message(msg)->from->agent->id);
-	agent_send(a->agent, distrm_message(msg)->from->agent, response);
 }
 
 static void handle_request_message(distrm_agent_t *a, message_t *msg) {
 	int *cores = tlm_malloc(a->agent->tlm, (a->agent->dcop->number_of_agents + 2) * sizeof(int));
 
-	for_each_entry(resource_t, r, &distrm_message(msg)->region->view->resources) {
-		agent_t *owner = cluster_resolve_core(a, r);
-		cores[owner->id]++;
+	view_t *v = distrm_message(msg)->region->view;
+
+	agent_t **owners = tlm_malloc(a->agent->tlm, v->size * sizeof(agent_t *));
+
+	cluster_resolve_cores(a, v, owners);
+
+	for (int i = 0; i < v->size; i++) {
+		if (owners[i]) {
+			cores[owners[i]->id]++;
+		}
 	}
 
+	tlm_free(a->agent->tlm, owners);
+
 	message_t *forward = distrm_message_new(a->agent->tlm, DISTRM_FORWARD);
 	distrm_message(forward)->region = distrm_message(msg)->region;
 	distrm_message(forward)->from = distrm_message(msg)->from;
+	distrm_message(forward)->request = distrm_message(msg)->request;
 
 	agent_t *handler = NULL;
 
@@ -365,150 +506,150 @@ static void handle_request_message(distrm_agent_t *a, message_t *msg) {
 
 #define min(x, y) (x < y ? x : y)
 
-static view_t * request_cores(distrm_agent_t *a) {
-	if (a->owned_cores->size > 0) {
-		int index;
-		random_r(&a->buf, &index);
-
-		index %= a->owned_cores->size;
-
-		resource_t *r = list_entry(a->owned_cores->resources.next, resource_t, _l);
-		for (int i = 1; i < index; i++) {
-			r = list_entry(r->_l.next, resource_t, _l);
-		}
+static void send_region_request(distrm_agent_t *a, distrm_pending_t *p, region_t *region, bool remote) {
+	message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REQUEST);
+	distrm_message(msg)->region = region;
+	distrm_message(msg)->from = a;
+	distrm_message(msg)->request = p->id;
 
-		a->core = resource_clone(r);
+	if (remote) {
+		agent_send(a->agent, cluster_resolve_core(a, region->center), msg);
 	} else {
-		a->core = distrm_get_random_core(a);
+		// TODO: technically this should be communication, too
+		handle_request_message(a, msg);
+
+		message_free(msg);
 	}
-	DEBUG_MESSAGE(a, "DistRM Agent seeded core: %i\n", a->core->index);
+}
 
-	view_t *offers = view_new_tlm(a->agent->tlm);
+// sends the requests of the current try of an invasion, offers are collected in the main loop
+static void request_cores(distrm_agent_t *a, distrm_pending_t *p) {
+	if (p->tries == 0) {
+		if (a->owned_cores->size > 0) {
+			int index;
+			random_r(&a->buf, &index);
 
-	for (int tries = 0; tries < try_limit && offers->size == 0; tries++) {
-		struct list_head *potential_regions = region_select_random(a, region_size, region_num);
+			index %= a->owned_cores->size;
 
-		int i = min(region_num, a->agent->dcop->hardware->number_of_resources);
-		for_each_entry_safe(region_t, region, _r, potential_regions) {
-			if (region_distance(region, a) < tries * (max_dist / try_limit) && random_d(a) > (double) 1 / tries) {
-				list_del(&region->_l);
-				region_free(region);
-				i--;
+			resource_t *r = list_entry(a->owned_cores->resources.next, resource_t, _l);
+			for (int i = 1; i < index; i++) {
+				r = list_entry(r->_l.next, resource_t, _l);
 			}
+
+			a->core = resource_clone(r);
+		} else {
+			a->core = distrm_get_random_core(a);
 		}
+		DEBUG_MESSAGE(a, "DistRM Agent seeded core: %i\n", a->core->index);
+	}
 
-		while (i > max_par_reqs) {
-			region_t *region = region_get_most_distant(a, potential_regions);
+	int tries = p->tries;
+
+	struct list_head *potential_regions = region_select_random(a, region_size, region_num);
+
+	int i = min(region_num, a->agent->dcop->hardware->number_of_resources);
+	for_each_entry_safe(region_t, region, _r, potential_regions) {
+		if (region_distance(region, a) < tries * (max_dist / try_limit) && random_d(a) > (double) 1 / tries) {
 			list_del(&region->_l);
 			region_free(region);
 			i--;
 		}
+	}
 
-		struct list_head *subregions = NULL;
-
-		int n = 0;
-
-		for_each_entry(region_t, region, potential_regions) {
-			DEBUG_MESSAGE(a, "trying region around core %i\n", region->center->index);
-
-			if (region_distance(region, a) > locality_thresh) {
-				if (cluster_resolve_core(a, region->center)->id != a->agent->id) {
-					send_request(a, region);
-				} else {
-					// TODO: technically this should be communication, too
-					message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REQUEST);
-					distrm_message(msg)->region = region;
-					distrm_message(msg)->from = a;
+	while (i > max_par_reqs) {
+		region_t *region = region_get_most_distant(a, potential_regions);
+		list_del(&region->_l);
+		region_free(region);
+		i--;
+	}
 
-					handle_request_message(a, msg);
+	struct list_head *subregions = NULL;
 
-					message_free(msg);
-				}
+	int n = 0;
 
-				n++;
-			} else {
-				if (region->size > size_thresh) {
-					subregions = region_split(region, size_thresh);
+	for_each_entry(region_t, region, potential_regions) {
+		DEBUG_MESSAGE(a, "trying region around core %i\n", region->center->index);
 
-					for_each_entry_safe(region_t, subregion, _s, subregions) {
-						if (cluster_resolve_core(a, subregion->center)->id != a->agent->id) {
-							send_request(a, subregion);
-						} else {
-							message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REQUEST);
-							distrm_message(msg)->region = subregion;
-							distrm_message(msg)->from = a;
+		if (region_distance(region, a) > locality_thresh) {
+			send_region_request(a, p, region, cluster_resolve_core(a, region->center)->id != a->agent->id);
 
-							handle_request_message(a, msg);
-
-							message_free(msg);
-						}
-
-						n++;
-					}
-				} else {
-					message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_REQUEST);
-					distrm_message(msg)->region = region;
-					distrm_message(msg)->from = a;
-
-					handle_request_message(a, msg);
+			n++;
+		} else {
+			if (region->size > size_thresh) {
+				struct list_head *split = region_split(region, size_thresh);
 
-					message_free(msg);
+				for_each_entry(region_t, subregion, split) {
+					send_region_request(a, p, subregion, cluster_resolve_core(a, subregion->center)->id != a->agent->id);
 
 					n++;
 				}
-			}
-		}
-
-		for (int i = 0; i < n; i++) {
-			message_t *offer = agent_recv_filter(a->agent, filter_distrm_offer, NULL);
 
-			DEBUG_MESSAGE(a, "(%i of %i) received offer from agent %i\n", i + 1, n, offer->from->id);
+				// subregions of all split regions are freed with the pending invasion
+				if (!subregions) {
+					subregions = split;
+				} else {
+					for_each_entry_safe(region_t, subregion, _s, split) {
+						list_del(&subregion->_l);
+						list_add_tail(&subregion->_l, subregions);
+					}
 
-			view_concat(offers, distrm_message(offer)->offer);
+					tlm_free(a->agent->tlm, split);
+				}
+			} else {
+				send_region_request(a, p, region, false);
 
-			message_free(offer);
+				n++;
+			}
 		}
-
-		region_free_all(a, subregions);
-
-		region_free_all(a, potential_regions);
-
 	}
 
-	resource_free(a->core);
-
-	return offers;
+	p->regions = potential_regions;
+	p->subregions = subregions;
+	p->remaining = n;
+	p->offered = 0;
 }
 
-static int handle_offer(distrm_agent_t *a, view_t *offer) {
-	int taken = 0;
+static void handle_offer(distrm_agent_t *a, distrm_pending_t *p) {
+	view_t *offer = p->offer;
 
-	double base = speedup(a, a->owned_cores);
+	// cores still awaiting confirmation count as held
+	int held = a->owned_cores->size + a->pending_cores->size;
+
+	double base = speedup_n(a, held);
 	for_each_entry(resource_t, r, &offer->resources) {
-		double s = speedup_with_core(a, a->owned_cores, r);
+		double s = speedup_n(a, held + 1);
 
 		agent_t *owner = distrm_get_agent(a->agent->dcop, r->owner);
 
-		if (s > base) {
+		if (s > base && !p->saturated) {
 			DEBUG_MESSAGE(a, "accepting core %i\n", r->index);
 
 			message_t *msg = distrm_message_new(a->agent->tlm, DISTRM_ACCEPT);
 			distrm_message(msg)->core = resource_new_tlm(a->agent->tlm);
 			distrm_message(msg)->core->index = r->index;
 			distrm_message(msg)->index = r->index;
+			distrm_message(msg)->request = p->id;
 
 			agent_send(a->agent, owner, msg);
 
 			resource_t *_r = resource_clone(r);
 			agent_claim_resource(a->agent, _r);
 
-			cluster_register_core(a, resource_clone(_r));
+			// with concurrent invasions the owner has to confirm the core first
+			if (concurrent == 1) {
+				view_add_resource(p->accepted, resource_clone(_r));
 
-			base = s;
+				p->taken++;
 
-			view_add_resource(a->owned_cores, _r);
+				view_add_resource(a->owned_cores, _r);
+			} else {
+				p->confirmations++;
+
+				view_add_resource(a->pending_cores, _r);
+			}
 
-			taken++;
+			base = s;
+			held++;
 		} else {
 			DEBUG_MESSAGE(a, "rejecting core %i\n", r->index);
 
@@ -522,8 +663,234 @@ static int handle_offer(distrm_agent_t *a, view_t *offer) {
 	}
 
 	view_free(offer);
+	p->offer = view_new_tlm(a->agent->tlm);
+
+	// when streaming, further offers are rejected once another core is hardly worth it
+	if (stream_gain >= 0 && speedup_n(a, held + 1) - speedup_n(a, held) < stream_gain) {
+		p->saturated = true;
+	}
+}
+
+static void handle_accept(distrm_agent_t *a, message_t *msg) {
+	int index = distrm_message(msg)->index;
+
+	if (concurrent == 1) {
+		resource_t *r = view_get_resource(a->reserved_cores, index);
+		view_del_resource(a->reserved_cores, r);
+		resource_free(r);
+
+		release_core(a, index);
+
+		cluster_cache_update(a, index, msg->from);
+
+		return;
+	}
 
-	return taken;
+	// first accept wins, later invaders are denied
+	resource_t *r = view_get_resource(a->owned_cores, index);
+
+	message_t *response = distrm_message_new(a->agent->tlm, r ? DISTRM_CONFIRM : DISTRM_DENY);
+	distrm_message(response)->index = index;
+	distrm_message(response)->request = distrm_message(msg)->request;
+
+	if (r) {
+		view_del_resource(a->owned_cores, r);
+		resource_free(r);
+
+		cluster_cache_update(a, index, msg->from);
+	}
+
+	agent_send(a->agent, msg->from, response);
+}
+
+static void handle_reject(distrm_agent_t *a, message_t *msg) {
+	int index = distrm_message(msg)->index;
+
+	if (concurrent == 1) {
+		resource_t *r = view_get_resource(a->reserved_cores, index);
+		view_del_resource(a->reserved_cores, r);
+		view_add_resource(a->owned_cores, r);
+
+		release_core(a, index);
+	}
+
+	cluster_cache_update(a, index, a->agent);
+}
+
+static bool invasion_done(distrm_agent_t *a, distrm_pending_t *p);
+
+static bool invasion_start(distrm_agent_t *a, distrm_pending_t *p) {
+	p->state = DISTRM_INVASION_OFFERS;
+	p->tries = 0;
+	p->denied = 0;
+	p->saturated = false;
+
+	request_cores(a, p);
+
+	if (p->remaining == 0) {
+		return invasion_done(a, p);
+	}
+
+	return false;
+}
+
+// returns true if the agent stops
+static bool invasion_end(distrm_agent_t *a, distrm_pending_t *p) {
+	int taken = p->taken;
+
+	__atomic_add_fetch(&latency_ns, now_ns() - p->start, __ATOMIC_RELAXED);
+
+	pending_free(a, p);
+
+	a->stale = (taken == 0);
+
+	a->rounds++;
+
+	a->was_invading = true;
+
+	DEBUG_MESSAGE(a, "\n\nround %i finished\n\n", rounds);
+
+	// the last invader to finish starts the next round
+	if (!distrm_finish(a, taken)) {
+		return false;
+	}
+
+	if (rounds < max_rounds * a->agent->dcop->number_of_agents) {
+		agent_broadcast(a->agent, a->agent->dcop, distrm_message_new(a->agent->tlm, DISTRM_INVADE));
+
+		return false;
+	}
+
+	agent_broadcast(a->agent, a->agent->dcop, distrm_message_new(a->agent->tlm, DISTRM_END));
+
+	dcop_stop_ROI(a->agent);
+
+	agent_send(a->agent, idle_agent->agent, distrm_message_new(a->agent->tlm, DISTRM_END));
+
+	cluster_stop();
+
+	return true;
+}
+
+// all offers or confirmations of the current step arrived
+static bool invasion_done(distrm_agent_t *a, distrm_pending_t *p) {
+	if (p->state == DISTRM_INVASION_OFFERS) {
+		region_free_all(a, p->subregions);
+		region_free_all(a, p->regions);
+		p->subregions = NULL;
+		p->regions = NULL;
+
+		__atomic_add_fetch(&probes, 1, __ATOMIC_RELAXED);
+		if (p->offered == 0) {
+			__atomic_add_fetch(&wasted, 1, __ATOMIC_RELAXED);
+		}
+
+		if (p->offered == 0 && !p->saturated && ++p->tries < try_limit) {
+			request_cores(a, p);
+
+			return (p->remaining == 0 ? invasion_done(a, p) : false);
+		}
+
+		handle_offer(a, p);
+
+		resource_free(a->core);
+
+		p->state = DISTRM_INVASION_CONFIRMATIONS;
+
+		if (p->confirmations > 0) {
+			return false;
+		}
+	}
+
+	cluster_register_cores(a, p->accepted);
+	view_free(p->accepted);
+	p->accepted = view_new_tlm(a->agent->tlm);
+
+	__atomic_add_fetch(&conflicts, p->denied, __ATOMIC_RELAXED);
+
+	// retries when all accepted cores were lost to other invaders
+	if (p->taken == 0 && p->denied > 0 && ++p->retries < try_limit) {
+		return invasion_start(a, p);
+	}
+
+	return invasion_end(a, p);
+}
+
+static bool handle_offer_message(distrm_agent_t *a, message_t *msg) {
+	distrm_pending_t *p = pending_get(a, distrm_message(msg)->request);
+	if (!p) {
+		print_warning("DistRM agent %i received offer for unknown request %i\n", a->agent->id, distrm_message(msg)->request);
+
+		return false;
+	}
+
+	view_concat(p->offer, distrm_message(msg)->offer);
+
+	if (p->type == DISTRM_PENDING_INVASION) {
+		p->offered += distrm_message(msg)->offer->size;
+
+		// streaming acceptance answers every offer right away
+		if (stream_gain >= 0) {
+			handle_offer(a, p);
+		}
+	}
+
+	if (--p->remaining > 0) {
+		return false;
+	}
+
+	if (p->type == DISTRM_PENDING_HANDLER) {
+		handler_complete(a, p);
+
+		return false;
+	}
+
+	return invasion_done(a, p);
+}
+
+static bool handle_confirmation(distrm_agent_t *a, message_t *msg) {
+	distrm_pending_t *p = pending_get(a, distrm_message(msg)->request);
+	if (!p) {
+		return false;
+	}
+
+	int index = distrm_message(msg)->index;
+
+	resource_t *r = view_get_resource(a->pending_cores, index);
+	if (r) {
+		view_del_resource(a->pending_cores, r);
+	} else {
+		print_warning("DistRM agent %i received confirmation for core %i it did not accept\n", a->agent->id, index);
+	}
+
+	if (r && distrm_message(msg)->type == DISTRM_CONFIRM) {
+		view_add_resource(p->accepted, resource_clone(r));
+		view_add_resource(a->owned_cores, r);
+
+		p->taken++;
+	} else {
+		DEBUG_MESSAGE(a, "lost core %i to another invader\n", index);
+
+		if (r) {
+			resource_free(r);
+		}
+
+		p->denied++;
+	}
+
+	if (--p->confirmations > 0 || p->state != DISTRM_INVASION_CONFIRMATIONS) {
+		return false;
+	}
+
+	return invasion_done(a, p);
+}
+
+static bool invade(distrm_agent_t *a) {
+	distrm_pending_t *p = pending_new(a, DISTRM_PENDING_INVASION);
+	p->accepted = view_new_tlm(a->agent->tlm);
+	p->start = now_ns();
+
+	return invasion_start(a, p);
 }
 
 static void * distrm(void *arg) {
@@ -533,10 +900,13 @@ static void * distrm(void *arg) {
 
 	a->was_invading = false;
 
+	INIT_LIST_HEAD(&a->pending);
+	a->next_request = 0;
+
 	tlm_touch(a->agent->tlm);
 
 	if (!distrm_is_idle_agent(a->agent->id)) {
-		dcop_start_ROI(a->agent->dcop);
+		dcop_start_ROI(a->agent);
 	}
 
 	bool stop = false;
@@ -561,8 +931,6 @@ static void * distrm(void *arg) {
 		DEBUG_MESSAGE("received %s (%i)\n", type_string, distrm_message(msg)->type);
 		*/
 
-		resource_t *r;
-
 		switch(distrm_message(msg)->type) {
 			case DISTRM_REQUEST:
 				handle_request_message(a, msg);
@@ -576,16 +944,21 @@ static void * distrm(void *arg) {
 				handle_make_offer(a, msg);
 				break;
 
+			case DISTRM_OFFER:
+				stop = handle_offer_message(a, msg);
+				break;
+
 			case DISTRM_ACCEPT:
-				r = view_get_resource(a->reserved_cores, distrm_message(msg)->index);
-				view_del_resource(a->reserved_cores, r);
-				resource_free(r);
+				handle_accept(a, msg);
 				break;
 
 			case DISTRM_REJECT:
-				r = view_get_resource(a->reserved_cores, distrm_message(msg)->index);
-				view_del_resource(a->reserved_cores, r);
-				view_add_resource(a->owned_cores, r);
+				handle_reject(a, msg);
+				break;
+
+			case DISTRM_CONFIRM:
+			case DISTRM_DENY:
+				stop = handle_confirmation(a, msg);
 				break;
 
 			case DISTRM_INVADE:
@@ -595,45 +968,14 @@ static void * distrm(void *arg) {
 					}
 
 					if (distrm_invade(a)) {
-						view_t *offer = request_cores(a);
-						if (handle_offer(a, offer) == 0) {
-							a->stale = true;
-							stale = true;
-						} else {
-							a->stale = false;
-							stale = false;
-						}
-
-						a->rounds++;
-
-						a->was_invading = true;
-
-						invading_agent = NULL;
-
-						ready = 0;
-
-						DEBUG_MESSAGE(a, "\n\nround %i finished\n\n", rounds);
-
-						if (rounds < max_rounds * a->agent->dcop->number_of_agents) {
-							agent_broadcast(a->agent, a->agent->dcop, distrm_message_new(a->agent->tlm, DISTRM_INVADE));
-						} else {
-							agent_broadcast(a->agent, a->agent->dcop, distrm_message_new(a->agent->tlm, DISTRM_END));
-
-							dcop_stop_ROI(a->agent->dcop);
-
-							agent_send(a->agent, idle_agent->agent, distrm_message_new(a->agent->tlm, DISTRM_END));
-
-							cluster_stop();
-
-							stop = true;
-						}
+						stop = invade(a);
 					} else {
 						a->was_invading = false;
 
-						if (!invading_agent) {
+						if (round_invaders == 0) {
 							DEBUG_MESSAGE(a, "stale resource assignment detected\n");
 
-							dcop_stop_ROI(a->agent->dcop);
+							dcop_stop_ROI(a->agent);
 
 							agent_send(a->agent, idle_agent->agent, distrm_message_new(a->agent->tlm, DISTRM_END));
 
@@ -649,7 +991,7 @@ static void * distrm(void *arg) {
 				stop = true;
 
 				if (!distrm_is_idle_agent(a->agent->id)) {
-					dcop_stop_ROI(a->agent->dcop);
+					dcop_stop_ROI(a->agent);
 				}
 
 				break;
@@ -662,6 +1004,10 @@ static void * distrm(void *arg) {
 		message_free(msg);
 	}
 
+	for_each_entry_safe(distrm_pending_t, p, _p, &a->pending) {
+		pending_free(a, p);
+	}
+
 	return (void *) a;
 }
 
@@ -675,11 +1021,26 @@ static void distrm_usage() {
 	printf("		maximum distance used by agents (number of rounds)\n");
 	printf("\n");
 	printf("	--region SIZE, -r SIZE\n");
-	printf("		size of region probed for resources\n");
+	printf("		size of region probed for resources (radius in NoC hops, in cores without a topology)\n");
 	printf("\n");
 	printf("	--requests NUM, -p NUM\n");
 	printf("		number of parallel requests\n");
 	printf("\n");
+	printf("	--shards NUM, -s NUM\n");
+	printf("		number of directory workers per cluster\n");
+	printf("\n");
+	printf("	--concurrent NUM, -n NUM\n");
+	printf("		number of agents invading at the same time\n");
+	printf("\n");
+	printf("	--stream GAIN, -g GAIN\n");
+	printf("		accept offers as they arrive until another core gains less than GAIN\n");
+	printf("\n");
+	printf("	--select MODE, -m MODE\n");
+	printf("		how region centers are chosen: random (default) or density (weighted by free cores per tile)\n");
+	printf("\n");
+	printf("	--lease ROUNDS, -l ROUNDS\n");
+	printf("		number of rounds cached core owners stay valid (0 disables the cache)\n");
+	printf("\n");
 }
 
 static int parse_arguments(int argc, char **argv) {
@@ -688,18 +1049,24 @@ static int parse_arguments(int argc, char **argv) {
 		{ "distance", required_argument, NULL, 'd' },
 		{ "region", required_argument, NULL, 'r' },
 		{ "request", required_argument, NULL, 'p' },
+		{ "lease", required_argument, NULL, 'l' },
+		{ "shards", required_argument, NULL, 's' },
+		{ "concurrent", required_argument, NULL, 'n' },
+		{ "stream", required_argument, NULL, 'g' },
+		{ "select", required_argument, NULL, 'm' },
 		{ 0 }
 	};
 
 	optind = 1;
 
 	while (true) {
-		int result = getopt_long(argc, argv, "c:d:r:p:", long_options, NULL);
+		int result = getopt_long(argc, argv, "c:d:r:p:l:s:n:g:m:", long_options, NULL);
 		if (result == -1) {
 			break;
 		}
 
 		int var;
+		double gain;
 
 		switch (result) {
 			case 'c':
@@ -746,6 +1113,62 @@ static int parse_arguments(int argc, char **argv) {
 				}
 				break;
 
+			case 'l':
+				var = (int) strtol(optarg, NULL, 10);
+				if (var < 0) {
+					print_error("distrm: invalid lease given\n");
+					print("distrm: using default lease %i\n", lease);
+				} else {
+					lease = var;
+					print("distrm: lease set to %i rounds\n", var);
+				}
+				break;
+
+			case 's':
+				var = (int) strtol(optarg, NULL, 10);
+				if (var <= 0) {
+					print_error("distrm: invalid number of shards given\n");
+					print("distrm: using default number of shards %i\n", shards);
+				} else {
+					shards = var;
+					print("distrm: number of shards set to %i\n", var);
+				}
+				break;
+
+			case 'n':
+				var = (int) strtol(optarg, NULL, 10);
+				if (var <= 0) {
+					print_error("distrm: invalid number of concurrent invaders given\n");
+					print("distrm: using default number of concurrent invaders %i\n", concurrent);
+				} else {
+					concurrent = var;
+					print("distrm: number of concurrent invaders set to %i\n", var);
+				}
+				break;
+
+			case 'g':
+				gain = strtod(optarg, NULL);
+				if (gain < 0) {
+					print_error("distrm: invalid gain given\n");
+				} else {
+					stream_gain = gain;
+					print("distrm: streaming offers until gain drops below %f\n", gain);
+				}
+				break;
+
+			case 'm':
+				if (!strcmp(optarg, "random")) {
+					select_density = false;
+				} else if (!strcmp(optarg, "density")) {
+					select_density = true;
+				} else {
+					print_error("distrm: invalid selection mode given\n");
+					print("distrm: using default selection mode random\n");
+					break;
+				}
+				print("distrm: selection mode set to %s\n", optarg);
+				break;
+
 			case '?':
 			case ':':
 			default:
@@ -787,14 +1210,27 @@ static void distrm_init(dcop_t *dcop, int argc, char **argv) {
 	parse_arguments(argc, argv);
 
 	pthread_mutex_init(&distrm_m, NULL);
-	pthread_cond_init(&distrm_cv, NULL);
+
+	round_barrier = barrier_new(dcop->number_of_agents, distrm_next_round, NULL);
 
 	stale = false;
 
-	cluster_load(dcop, cluster_size);
+	invaders = 0;
+	invasions = 0;
+	successful = 0;
+	conflicts = 0;
+	probes = 0;
+	wasted = 0;
+	hold_ns = 0;
+	holds = 0;
+	latency_ns = 0;
+
+	idle_id = dcop->number_of_agents + 1;
+
+	cluster_load(dcop, cluster_size, shards, lease);
 
 	agent_t *agent = agent_new();
-	agent->id = dcop->number_of_agents + 1;
+	agent->id = idle_id;
 
 	agent->dcop = dcop;
 
@@ -805,6 +1241,11 @@ static void distrm_init(dcop_t *dcop, int argc, char **argv) {
 
 	idle_agent->owned_cores = view_new_tlm(agent->tlm);
 	idle_agent->reserved_cores = view_new_tlm(agent->tlm);
+	idle_agent->pending_cores = view_new_tlm(agent->tlm);
+
+	cluster_cache_new(idle_agent);
+
+	idle_agent->reserved_at = tlm_malloc(agent->tlm, dcop->hardware->number_of_resources * sizeof(unsigned long long));
 
 	for_each_entry(resource_t, r, &dcop->hardware->view->resources) {
 		resource_t *_r = resource_new_tlm(agent->tlm);
@@ -819,11 +1260,11 @@ static void distrm_init(dcop_t *dcop, int argc, char **argv) {
 			view_add_resource(idle_agent->owned_cores, _r);
 
 			agent_claim_resource(agent, _r);
-
-			cluster_register_core(idle_agent, resource_clone(_r));
 		}
 	}
 
+	cluster_register_cores(idle_agent, idle_agent->owned_cores);
+
 	agent_create_thread(agent, distrm, idle_agent);
 
 	print("created idle thread\n");
@@ -835,10 +1276,14 @@ static void distrm_init(dcop_t *dcop, int argc, char **argv) {
 
 		_a->owned_cores = view_new_tlm(a->tlm);
 		_a->reserved_cores = view_new_tlm(a->tlm);
+		_a->pending_cores = view_new_tlm(a->tlm);
 
-		char statebuf[8];
-		unsigned int seed = time(NULL) / a->id;
-		initstate_r(seed, statebuf, sizeof(statebuf), &_a->buf);
+		cluster_cache_new(_a);
+
+		_a->reserved_at = tlm_malloc(a->tlm, dcop->hardware->number_of_resources * sizeof(unsigned long long));
+
+		unsigned int seed = dcop_get_seed() + a->id;
+		initstate_r(seed, _a->statebuf, sizeof(_a->statebuf), &_a->buf);
 		srandom_r(seed, &_a->buf);
 
 		double *param;
@@ -854,14 +1299,16 @@ static void distrm_init(dcop_t *dcop, int argc, char **argv) {
 			_a->sigma = random_d(_a) * 2.5;
 		}
 
+		init_speedups(_a);
+
 		for_each_entry(resource_t, r, &a->view->resources) {
 			if (agent_is_owner(a, r)) {
 				view_add_resource(_a->owned_cores, resource_clone(r));
-
-				cluster_register_core(_a, resource_clone(r));
 			}
 		}
 
+		cluster_register_cores(_a, _a->owned_cores);
+
 		_a->stale = false;
 
 		agent_create_thread(a, distrm, _a);
@@ -875,11 +1322,25 @@ static void distrm_cleanup(dcop_t *dcop) {
 
 	print_debug("distrm: finished after %i rounds\n", rounds);
 
+	agent_cleanup_thread(idle_agent->agent);
+
+	unsigned long hits = idle_agent->cache_hits;
+	unsigned long misses = idle_agent->cache_misses;
+
 	for_each_entry(agent_t, a, &dcop->agents) {
 		distrm_agent_t *_a = (distrm_agent_t *) agent_cleanup_thread(a);
 
+		hits += _a->cache_hits;
+		misses += _a->cache_misses;
+
+		cluster_cache_free(_a);
+
+		tlm_free(a->tlm, _a->reserved_at);
+		tlm_free(a->tlm, _a->speedups);
+
 		view_free(_a->owned_cores);
 		view_free(_a->reserved_cores);
+		view_free(_a->pending_cores);
 
 		tlm_free(a->tlm, _a);
 
@@ -888,11 +1349,21 @@ static void distrm_cleanup(dcop_t *dcop) {
 
 	view_free(system);
 
-	agent_cleanup_thread(idle_agent->agent);
+	print_debug("distrm: directory cache hits %lu misses %lu\n", hits, misses);
+	print_debug("distrm: %lu invasions (%lu successful), %lu conflicts\n", invasions, successful, conflicts);
+	print_debug("distrm: %lu of %lu tries wasted on regions without offers\n", wasted, probes);
+	print_debug("distrm: average reserved core hold time %.3f us, average invasion latency %.3f us\n", holds ? (double) hold_ns / holds / 1000 : 0, invasions ? (double) latency_ns / invasions / 1000 : 0);
+
+	cluster_cache_free(idle_agent);
 	agent_free(idle_agent->agent);
+	idle_agent = NULL;
 
 	pthread_mutex_destroy(&distrm_m);
-	pthread_cond_destroy(&distrm_cv);
+
+	barrier_print_stats(round_barrier, "distrm round");
+
+	barrier_free(round_barrier);
+	round_barrier = NULL;
 }
 
 static void distrm_run(dcop_t *dcop) {
@@ -6,24 +6,77 @@
 
 typedef struct distrm_agent distrm_agent_t;
 
+// cached directory entry, valid until round expires
+typedef struct distrm_cache_entry {
+	struct agent *owner;
+	int expires;
+} distrm_cache_entry_t;
+
 #include "agent.h"
 #include "dcop.h"
+#include "list.h"
 #include "region.h"
 #include "resource.h"
 #include "tlm.h"
 #include "view.h"
 
+/*
+ * Negotiations an agent takes part in: as handler it collects the offers of
+ * neighbors for a region, as invader the offers for its requests and then the
+ * confirmations of accepted cores. Messages refer to entries by id.
+ */
+typedef struct distrm_pending {
+	struct list_head _l;
+	int id;
+	enum {
+		DISTRM_PENDING_HANDLER,
+		DISTRM_PENDING_INVASION
+	} type;
+	int remaining;
+	view_t *offer;
+	/* handler */
+	distrm_agent_t *from;
+	region_t *region;
+	int request;
+	/* invasion */
+	enum {
+		DISTRM_INVASION_OFFERS,
+		DISTRM_INVASION_CONFIRMATIONS
+	} state;
+	int tries;
+	int retries;
+	struct list_head *regions;
+	struct list_head *subregions;
+	int offered;
+	int confirmations;
+	bool saturated;
+	int taken;
+	int denied;
+	view_t *accepted;
+	unsigned long long start;
+} distrm_pending_t;
+
 struct distrm_agent {
 	agent_t *agent;
 	struct random_data buf;
+	char statebuf[32];
 	resource_t *core;
 	double A;
 	double sigma;
+	double *speedups;
 	view_t *owned_cores;
 	view_t *reserved_cores;
+	// accepted cores awaiting CONFIRM or DENY, neither offered nor given away meanwhile
+	view_t *pending_cores;
 	bool stale;
 	int rounds;
 	bool was_invading;
+	distrm_cache_entry_t *cache;
+	unsigned long cache_hits;
+	unsigned long cache_misses;
+	struct list_head pending;
+	int next_request;
+	unsigned long long *reserved_at;
 };
 
 typedef struct distrm_message {
@@ -32,6 +85,9 @@ typedef struct distrm_message {
 		DISTRM_REGISTER,
 		DISTRM_LOCATE,
 		DISTRM_INFO,
+		DISTRM_REGISTER_BATCH,
+		DISTRM_LOCATE_BATCH,
+		DISTRM_INFO_BATCH,
 		/* distrm agent messages */
 		DISTRM_REQUEST,
 		DISTRM_OFFER,
@@ -39,6 +95,8 @@ typedef struct distrm_message {
 		DISTRM_MAKE_OFFER,
 		DISTRM_ACCEPT,
 		DISTRM_REJECT,
+		DISTRM_CONFIRM,
+		DISTRM_DENY,
 		/* dcop interface */
 		DISTRM_INVADE,
 		DISTRM_END
@@ -69,6 +127,10 @@ typedef struct distrm_message {
 	int num_neighbors;
 	agent_t **neighbors;
 	view_t *offer;
+	int num_cores;
+	int *cores;
+	agent_t **owners;
+	int request;
 } distrm_message_t;
 
 message_t * distrm_message_new(tlm_t *tlm, int type);
@@ -81,6 +143,8 @@ agent_t * distrm_get_agent(dcop_t *dcop, int id);
 
 bool distrm_is_idle_agent(int id);
 
+int distrm_get_round();
+
 resource_t * distrm_get_random_core(distrm_agent_t *a);
 
 void distrm_register();
@@ -0,0 +1,1129 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent.h"
+#include "algorithm.h"
+#include "console.h"
+#include "constraint.h"
+#include "dcop.h"
+#include "dpop.h"
+#include "list.h"
+#include "resource.h"
+#include "view.h"
+
+/*
+ * DPOP: the agents are arranged in a DFS pseudo-tree over the neighbor graph.
+ * UTIL tables are propagated bottom-up, every table maps the assignments of
+ * the separator (the ancestors constrained with the subtree) to the best
+ * rating of the subtree. The optimal assignments are then propagated
+ * top-down in VALUE messages.
+ *
+ * An assignment is the set of resources owned by an agent. Domains are built
+ * from a limited number of candidate resources (owned, free or owned by a
+ * neighbor) and only contain the best feasible assignments, the result is
+ * optimal with respect to these domains. It is reported as optimal only if
+ * every resource is a candidate and no feasible assignment was pruned.
+ *
+ * Only the pseudo-tree is derived before the start, from the neighbor graph
+ * with every constraint scope as a clique, so each scope lies on one branch.
+ * Every agent builds its domain and exchanges it with its neighbors, then
+ * rates its own constraints over the domains of their scope and sends the
+ * rating tables to the deepest agent of the scope, which joins them with the
+ * UTIL tables of its children.
+ *
+ * If a table would exceed the memory bound, agents are cut (MB-DPOP): the
+ * table is conditioned on their current assignment instead of having a
+ * dimension for them. Optimality is no longer guaranteed then.
+ */
+
+#define DPOP_MAX_CANDIDATES 24
+
+typedef struct dpop_dim {
+	int id;
+	int domain_size;
+	int current;
+	size_t stride;
+} dpop_dim_t;
+
+// maps the assignments of the agents in dims to a rating
+typedef struct dpop_table {
+	tlm_t *tlm;
+	int number_of_dims;
+	dpop_dim_t *dims;
+	size_t size;
+	double *values;
+} dpop_table_t;
+
+typedef struct dpop_message {
+	enum {
+		DPOP_DOMAIN,
+		DPOP_RATING,
+		DPOP_UTIL,
+		DPOP_VALUE,
+		DPOP_FINAL,
+		DPOP_END,
+		DPOP_START
+	} type;
+	int *context;
+	view_t *view;
+	int domain_size;
+	int current;
+	view_t **domain;
+	dpop_table_t *table;
+} dpop_message_t;
+
+// constraint (or the whole rating of a lua agent if c is NULL) with its scope, scope[0] owns it
+typedef struct dpop_constraint {
+	struct list_head _l;
+	constraint_t *c;
+	int scope_size;
+	int *scope;
+	agent_t *deepest;
+} dpop_constraint_t;
+
+// domain of a neighbor as seen by the agent
+typedef struct dpop_domain {
+	int size;
+	int current;
+	view_t **foreign;
+} dpop_domain_t;
+
+typedef struct dpop_agent {
+	agent_t *agent;
+	int number_of_links;
+	struct dpop_agent **links;
+	bool visited;
+	int depth;
+	struct dpop_agent *parent;
+	int number_of_children;
+	struct dpop_agent **children;
+	int number_of_ratings;
+	int number_of_separators;
+	int number_of_cuts;
+	int domain_size;
+	// the domain is complete if every resource is a candidate and no feasible assignment was pruned
+	bool complete;
+	size_t pruned;
+	view_t **own;
+	view_t **foreign;
+	int current;
+	int value;
+	// indexed by agent id
+	dpop_domain_t *domains;
+	struct list_head constraints;
+	int number_of_tables;
+	dpop_table_t **tables;
+	dpop_table_t *util;
+	size_t util_size;
+	double best;
+	double initial_eval;
+	double eval;
+} dpop_agent_t;
+
+static algorithm_t _dpop;
+
+static size_t memory_bound = 8 * 1024 * 1024;
+static int max_domain = 64;
+static int max_candidates = 16;
+
+// indexed by agent id, only used to set up the pseudo-tree before the agents start
+static dpop_agent_t **agents = NULL;
+
+// set if a constraint can't be placed in the pseudo-tree, nothing is solved then
+static bool failed = false;
+
+#define dpop_message(m) ((dpop_message_t *) m->buf)
+
+#define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
+
+static void dpop_table_free(dpop_table_t *t) {
+	free(t->values);
+	tlm_free(t->tlm, t->dims);
+	tlm_free(t->tlm, t);
+}
+
+static void dpop_domain_free(tlm_t *tlm, view_t **domain, int size) {
+	for (int i = 0; i < size; i++) {
+		view_free(domain[i]);
+	}
+
+	tlm_free(tlm, domain);
+}
+
+static void dpop_message_free(tlm_t *tlm, void *buf) {
+	dpop_message_t *msg = (dpop_message_t *) buf;
+
+	if (msg) {
+		if (msg->context) {
+			tlm_free(tlm, msg->context);
+		}
+
+		if (msg->view) {
+			view_free(msg->view);
+		}
+
+		if (msg->domain) {
+			dpop_domain_free(tlm, msg->domain, msg->domain_size);
+		}
+
+		if (msg->table) {
+			dpop_table_free(msg->table);
+		}
+
+		tlm_free(tlm, msg);
+	}
+}
+
+static message_t * dpop_message_new(dpop_agent_t *a, int type, size_t size) {
+	tlm_t *tlm = a ? a->agent->tlm : NULL;
+
+	dpop_message_t *msg = (dpop_message_t *) tlm_malloc(tlm, sizeof(dpop_message_t));
+	msg->type = type;
+
+	return message_new(tlm, msg, sizeof(dpop_message_t) + size, dpop_message_free);
+}
+
+static bool filter_dpop_message(message_t *msg, void *type) {
+	return dpop_message(msg)->type == DPOP_END || dpop_message(msg)->type == (long) type;
+}
+
+static bool is_ancestor(dpop_agent_t *a, dpop_agent_t *d) {
+	for (; d; d = d->parent) {
+		if (d == a) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void add_link(dpop_agent_t *a, dpop_agent_t *b) {
+	if (a == b) {
+		return;
+	}
+
+	for (int i = 0; i < a->number_of_links; i++) {
+		if (a->links[i] == b) {
+			return;
+		}
+	}
+
+	a->links[a->number_of_links++] = b;
+	b->links[b->number_of_links++] = a;
+}
+
+// the pseudo-tree is built over the neighbor graph with every scope as a clique, so every scope lies on one branch
+static void build_pseudo_tree(dpop_agent_t *a, dpop_agent_t *parent, int depth) {
+	a->visited = true;
+	a->parent = parent;
+	a->depth = depth;
+
+	for (int i = 0; i < a->number_of_links; i++) {
+		dpop_agent_t *_a = a->links[i];
+
+		if (!_a->visited) {
+			a->children[a->number_of_children++] = _a;
+
+			build_pseudo_tree(_a, a, depth + 1);
+		}
+	}
+}
+
+// every constraint is rated by its owner, the owner only learns the domains of its neighbors
+static bool load_constraint(dpop_agent_t *a, constraint_t *c, int number_of_neighbors, int *neighbors) {
+	for (int i = 0; i < number_of_neighbors; i++) {
+		if (neighbors[i] != a->agent->id && !agent_is_neighbor(a->agent, agents[neighbors[i]]->agent)) {
+			print_error("dpop: agent %i in scope of constraint '%s' of agent %i is not a neighbor\n", neighbors[i], c ? c->name : "rate_view", a->agent->id);
+
+			return false;
+		}
+	}
+
+	dpop_constraint_t *dc = (dpop_constraint_t *) tlm_malloc(a->agent->tlm, sizeof(dpop_constraint_t));
+	dc->c = c;
+	dc->scope = (int *) tlm_malloc(a->agent->tlm, (number_of_neighbors + 1) * sizeof(int));
+	dc->scope[dc->scope_size++] = a->agent->id;
+
+	for (int i = 0; i < number_of_neighbors; i++) {
+		dc->scope[dc->scope_size++] = neighbors[i];
+	}
+
+	for (int i = 0; i < dc->scope_size; i++) {
+		for (int j = i + 1; j < dc->scope_size; j++) {
+			add_link(agents[dc->scope[i]], agents[dc->scope[j]]);
+		}
+	}
+
+	list_add_tail(&dc->_l, &a->constraints);
+
+	return true;
+}
+
+static bool load_constraints(dpop_agent_t *a) {
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		add_link(a, agents[n->agent->id]);
+	}
+
+	if (!a->agent->has_native_constraints) {
+		int neighbors[a->agent->number_of_neighbors];
+
+		int i = 0;
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			neighbors[i++] = n->agent->id;
+		}
+
+		return load_constraint(a, NULL, i, neighbors);
+	}
+
+	for_each_entry(constraint_t, c, &a->agent->constraints) {
+		if (!load_constraint(a, c, c->param.number_of_neighbors, c->param.neighbors)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// constraints are joined by the deepest agent of their scope
+static bool assign_constraints(dpop_agent_t *a) {
+	for_each_entry(dpop_constraint_t, dc, &a->constraints) {
+		dpop_agent_t *deepest = a;
+
+		for (int i = 1; i < dc->scope_size; i++) {
+			if (agents[dc->scope[i]]->depth > deepest->depth) {
+				deepest = agents[dc->scope[i]];
+			}
+		}
+
+		for (int i = 0; i < dc->scope_size; i++) {
+			if (!is_ancestor(agents[dc->scope[i]], deepest)) {
+				print_error("dpop: scope of constraint '%s' of agent %i is not on a branch of the pseudo-tree\n", dc->c ? dc->c->name : "rate_view", a->agent->id);
+
+				return false;
+			}
+		}
+
+		dc->deepest = deepest->agent;
+		if (deepest != a) {
+			deepest->number_of_ratings++;
+		}
+	}
+
+	return true;
+}
+
+typedef struct assignment {
+	unsigned long mask;
+	double rating;
+	int size;
+} assignment_t;
+
+static int compare_assignment(const void *a, const void *b) {
+	const assignment_t *x = (const assignment_t *) a;
+	const assignment_t *y = (const assignment_t *) b;
+
+	if (x->rating != y->rating) {
+		return x->rating < y->rating ? -1 : 1;
+	}
+
+	if (x->size != y->size) {
+		return x->size - y->size;
+	}
+
+	return x->mask < y->mask ? -1 : x->mask > y->mask;
+}
+
+static int get_candidate_class(dpop_agent_t *a, resource_t *r) {
+	int owner = resource_get_owner(r);
+
+	if (owner == a->agent->id) {
+		return 0;
+	} else if (owner < 0) {
+		return 1;
+	} else if (agent_is_neighbor(a->agent, dcop_get_agent(a->agent->dcop, owner))) {
+		return 2;
+	}
+
+	return -1;
+}
+
+static view_t * create_assignment(view_t *base, resource_t **candidates, int c, unsigned long mask, int id, bool foreign) {
+	view_t *v = view_clone(base);
+
+	for_each_entry(resource_t, r, &v->resources) {
+		if (foreign) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+
+		for (int i = 0; i < c; i++) {
+			if (candidates[i]->index == r->index && (mask & (1UL << i))) {
+				r->status = RESOURCE_STATUS_TAKEN;
+				r->owner = id;
+			}
+		}
+	}
+
+	return v;
+}
+
+/*
+ * the domain consists of the best subsets of the candidate resources, rated
+ * with neighbors that don't own any resources
+ */
+static void load_domain(dpop_agent_t *a) {
+	agent_t *agent = a->agent;
+
+	resource_t *candidates[max_candidates];
+	int c = 0;
+
+	// owned resources first, then free ones, then those of neighbors
+	for (int class = 0; class < 3; class++) {
+		for_each_entry(resource_t, r, &agent->view->resources) {
+			if (c < max_candidates && get_candidate_class(a, r) == class) {
+				candidates[c++] = r;
+			}
+		}
+	}
+
+	a->complete = c == agent->view->size;
+
+	if (view_count_resources(agent->view, agent->id) > max_candidates) {
+		print_warning("dpop: agent %i owns more than %i resources, current assignment not in domain\n", agent->id, max_candidates);
+	}
+
+	unsigned long current = 0;
+	for (int i = 0; i < c; i++) {
+		if (agent_is_owner(agent, candidates[i])) {
+			current |= 1UL << i;
+		}
+	}
+
+	// resources of neighbors are represented by their agent view only
+	view_t *base = view_clone(agent->view);
+	for_each_entry(resource_t, r, &base->resources) {
+		int class = get_candidate_class(a, r);
+		if (class == 0 || class == 2) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+
+	view_t *empty = create_assignment(base, candidates, c, 0, agent->id, true);
+	view_t *agent_view[agent->dcop->number_of_agents + 1];
+	for_each_entry(neighbor_t, n, &agent->neighbors) {
+		agent_view[n->agent->id] = agent->agent_view[n->agent->id];
+		agent->agent_view[n->agent->id] = empty;
+	}
+
+	view_t *v = view_clone(base);
+	resource_t *resources[c];
+	for (int i = 0; i < c; i++) {
+		resources[i] = view_get_resource(v, candidates[i]->index);
+	}
+
+	size_t n = 1UL << c;
+	// the power set may exceed the size of the thread local memory
+	assignment_t *assignments = (assignment_t *) calloc(n, sizeof(assignment_t));
+	size_t feasible = 0;
+	double current_rating = INFINITY;
+
+	for (unsigned long mask = 0; mask < n; mask++) {
+		int size = 0;
+		for (int i = 0; i < c; i++) {
+			if (mask & (1UL << i)) {
+				agent_claim_resource(agent, resources[i]);
+				size++;
+			} else {
+				agent_yield_resource(resources[i]);
+			}
+		}
+
+		double rating = agent_evaluate_view(agent, v);
+
+		if (mask == current) {
+			current_rating = rating;
+		}
+
+		if (isfinite(rating)) {
+			assignments[feasible].mask = mask;
+			assignments[feasible].rating = rating;
+			assignments[feasible].size = size;
+			feasible++;
+		}
+	}
+
+	for_each_entry(neighbor_t, n, &agent->neighbors) {
+		agent->agent_view[n->agent->id] = agent_view[n->agent->id];
+	}
+
+	qsort(assignments, feasible, sizeof(assignment_t), compare_assignment);
+
+	a->domain_size = feasible < (size_t) max_domain ? (int) feasible : max_domain;
+
+	a->current = -1;
+	for (int i = 0; i < a->domain_size; i++) {
+		if (assignments[i].mask == current) {
+			a->current = i;
+		}
+	}
+
+	// the current assignment is always part of the domain, cut agents are conditioned on it
+	if (a->current < 0) {
+		if (a->domain_size == max_domain) {
+			a->domain_size--;
+		}
+		a->current = a->domain_size++;
+		assignments[a->current].mask = current;
+		assignments[a->current].rating = current_rating;
+	}
+
+	// an infeasible current assignment doesn't count as kept
+	size_t kept = isfinite(assignments[a->current].rating) ? a->domain_size : a->domain_size - 1;
+	a->pruned = feasible - kept;
+	if (a->pruned > 0) {
+		a->complete = false;
+	}
+
+	a->own = (view_t **) tlm_malloc(agent->tlm, a->domain_size * sizeof(view_t *));
+	a->foreign = (view_t **) tlm_malloc(agent->tlm, a->domain_size * sizeof(view_t *));
+
+	for (int i = 0; i < a->domain_size; i++) {
+		a->own[i] = create_assignment(base, candidates, c, assignments[i].mask, agent->id, false);
+		a->foreign[i] = create_assignment(base, candidates, c, assignments[i].mask, agent->id, true);
+	}
+
+	a->domains[agent->id].size = a->domain_size;
+	a->domains[agent->id].current = a->current;
+	a->domains[agent->id].foreign = a->foreign;
+
+	DEBUG_MESSAGE(a, "%zu of %zu assignments feasible, %zu pruned, domain size %i\n", feasible, n, a->pruned, a->domain_size);
+
+	free(assignments);
+	view_free(v);
+	view_free(empty);
+	view_free(base);
+}
+
+static message_t * create_domain_message(dpop_agent_t *a) {
+	message_t *msg = dpop_message_new(a, DPOP_DOMAIN, a->domain_size * a->agent->view->size * sizeof(resource_t));
+	dpop_message(msg)->domain_size = a->domain_size;
+	dpop_message(msg)->current = a->current;
+	dpop_message(msg)->domain = (view_t **) tlm_malloc(a->agent->tlm, a->domain_size * sizeof(view_t *));
+
+	for (int i = 0; i < a->domain_size; i++) {
+		dpop_message(msg)->domain[i] = view_clone(a->foreign[i]);
+	}
+
+	return msg;
+}
+
+// the views are taken from the message
+static void add_domain(dpop_agent_t *a, agent_t *from, dpop_message_t *msg) {
+	a->domains[from->id].size = msg->domain_size;
+	a->domains[from->id].current = msg->current;
+	a->domains[from->id].foreign = (view_t **) tlm_malloc(a->agent->tlm, msg->domain_size * sizeof(view_t *));
+
+	memcpy(a->domains[from->id].foreign, msg->domain, msg->domain_size * sizeof(view_t *));
+
+	msg->domain_size = 0;
+}
+
+// agents with the largest domains are cut until the table fits the memory bound, keep is never cut
+static dpop_table_t * create_table(tlm_t *tlm, dpop_dim_t *dims, int n, int keep, int *cuts) {
+	bool cut[n];
+	memset(cut, 0, sizeof(cut));
+
+	double size = 1;
+	for (int i = 0; i < n; i++) {
+		size *= dims[i].domain_size;
+	}
+
+	while (size * sizeof(double) > memory_bound) {
+		int largest = -1;
+		for (int i = 0; i < n; i++) {
+			if (!cut[i] && dims[i].id != keep && (largest < 0 || dims[i].domain_size > dims[largest].domain_size)) {
+				largest = i;
+			}
+		}
+
+		if (largest < 0) {
+			break;
+		}
+
+		cut[largest] = true;
+		size /= dims[largest].domain_size;
+		(*cuts)++;
+	}
+
+	dpop_table_t *t = (dpop_table_t *) tlm_malloc(tlm, sizeof(dpop_table_t));
+	t->tlm = tlm;
+	t->dims = (dpop_dim_t *) tlm_malloc(tlm, n * sizeof(dpop_dim_t));
+	t->size = 1;
+
+	for (int i = 0; i < n; i++) {
+		if (!cut[i]) {
+			t->dims[t->number_of_dims] = dims[i];
+			t->dims[t->number_of_dims].stride = t->size;
+			t->size *= dims[i].domain_size;
+			t->number_of_dims++;
+		}
+	}
+
+	// the memory bound may exceed the size of the thread local memory
+	t->values = (double *) calloc(t->size, sizeof(double));
+
+	return t;
+}
+
+static void load_context(dpop_table_t *t, size_t index, int *context) {
+	for (int i = 0; i < t->number_of_dims; i++) {
+		context[t->dims[i].id] = (index / t->dims[i].stride) % t->dims[i].domain_size;
+	}
+}
+
+static double lookup_table(dpop_table_t *t, int *context) {
+	size_t index = 0;
+	for (int i = 0; i < t->number_of_dims; i++) {
+		index += context[t->dims[i].id] * t->dims[i].stride;
+	}
+
+	return t->values[index];
+}
+
+static size_t get_table_size(dpop_table_t *t) {
+	return t->number_of_dims * sizeof(dpop_dim_t) + t->size * sizeof(double);
+}
+
+// rates a constraint of the agent for all assignments of its scope
+static dpop_table_t * rate_constraint(dpop_agent_t *a, dpop_constraint_t *dc, int *context) {
+	agent_t *agent = a->agent;
+
+	dpop_dim_t dims[dc->scope_size];
+	for (int i = 0; i < dc->scope_size; i++) {
+		dims[i].id = dc->scope[i];
+		dims[i].domain_size = a->domains[dc->scope[i]].size;
+		dims[i].current = a->domains[dc->scope[i]].current;
+
+		// cut agents are conditioned on their current assignment
+		context[dims[i].id] = dims[i].current;
+	}
+
+	dpop_table_t *t = create_table(agent->tlm, dims, dc->scope_size, dc->deepest->id, &a->number_of_cuts);
+
+	view_t *agent_view[dc->scope_size];
+	for (int i = 1; i < dc->scope_size; i++) {
+		agent_view[i] = agent->agent_view[dc->scope[i]];
+	}
+
+	agent_t *_agent = evaluated_agent;
+	view_t *_view = evaluated_view;
+
+	evaluated_agent = agent;
+
+	for (size_t index = 0; index < t->size; index++) {
+		load_context(t, index, context);
+
+		for (int i = 1; i < dc->scope_size; i++) {
+			agent->agent_view[dc->scope[i]] = a->domains[dc->scope[i]].foreign[context[dc->scope[i]]];
+		}
+
+		evaluated_view = a->own[context[agent->id]];
+
+		t->values[index] = dc->c ? dc->c->eval(dc->c) : agent_evaluate(agent);
+	}
+
+	evaluated_agent = _agent;
+	evaluated_view = _view;
+
+	for (int i = 1; i < dc->scope_size; i++) {
+		agent->agent_view[dc->scope[i]] = agent_view[i];
+	}
+
+	return t;
+}
+
+// best rating of the subtree of a for the assignments of its ancestors given in the context
+static double get_best_value(dpop_agent_t *a, int *context, int *value) {
+	double best = INFINITY;
+
+	if (value) {
+		*value = a->current;
+	}
+
+	for (int v = 0; v < a->domain_size; v++) {
+		context[a->agent->id] = v;
+
+		double r = 0;
+
+		for (int i = 0; isfinite(r) && i < a->number_of_tables; i++) {
+			r += lookup_table(a->tables[i], context);
+		}
+
+		if (r < best) {
+			best = r;
+
+			if (value) {
+				*value = v;
+			}
+		}
+	}
+
+	return best;
+}
+
+// the separator consists of all agents in the joined tables except the agent itself
+static void compute_util(dpop_agent_t *a, int *context) {
+	dpop_dim_t separator[a->agent->dcop->number_of_agents + 1];
+	int n = 0;
+
+	for (int i = 0; i < a->number_of_tables; i++) {
+		for (int j = 0; j < a->tables[i]->number_of_dims; j++) {
+			dpop_dim_t *d = &a->tables[i]->dims[j];
+
+			bool known = d->id == a->agent->id;
+			for (int k = 0; !known && k < n; k++) {
+				known = separator[k].id == d->id;
+			}
+
+			if (!known) {
+				separator[n++] = *d;
+
+				// cut agents are conditioned on their current assignment
+				context[d->id] = d->current;
+			}
+		}
+	}
+
+	a->number_of_separators = n;
+	a->util = create_table(a->agent->tlm, separator, n, -1, &a->number_of_cuts);
+	a->util_size = a->util->size;
+
+	for (size_t index = 0; index < a->util->size; index++) {
+		load_context(a->util, index, context);
+
+		a->util->values[index] = get_best_value(a, context, NULL);
+	}
+
+	if (a->number_of_cuts > 0) {
+		print_warning("dpop: memory bound exceeded at agent %i, %i agents cut\n", a->agent->id, a->number_of_cuts);
+	}
+}
+
+static void add_table(dpop_agent_t *a, dpop_message_t *msg) {
+	a->tables[a->number_of_tables++] = msg->table;
+
+	msg->table = NULL;
+}
+
+// conflicting claims of neighbors are resolved in favour of the agent with the lowest id
+static void merge_final_view(dpop_agent_t *a, agent_t *from, view_t *view) {
+	view_copy(a->agent->agent_view[from->id], view);
+
+	for_each_entry(resource_t, r, &view->resources) {
+		if (resource_get_owner(r) == from->id) {
+			resource_t *_r = view_get_resource(a->agent->view, r->index);
+
+			if (!agent_is_owner(a->agent, _r) || from->id < a->agent->id) {
+				agent_claim_resource(from, _r);
+			}
+		}
+	}
+}
+
+static void * dpop(void *arg) {
+	dpop_agent_t *a = (dpop_agent_t *) arg;
+
+	tlm_touch(a->agent->tlm);
+
+	a->initial_eval = agent_evaluate(a->agent);
+
+	dcop_start_ROI(a->agent);
+
+	size_t context_size = (a->agent->dcop->number_of_agents + 1) * sizeof(int);
+	int *context = (int *) tlm_malloc(a->agent->tlm, context_size);
+	memset(context, 0, context_size);
+
+	a->domains = (dpop_domain_t *) tlm_malloc(a->agent->tlm, (a->agent->dcop->number_of_agents + 1) * sizeof(dpop_domain_t));
+
+	int number_of_constraints = 0;
+	for_each_entry(dpop_constraint_t, dc, &a->constraints) {
+		number_of_constraints++;
+	}
+	a->tables = (dpop_table_t **) tlm_malloc(a->agent->tlm, (number_of_constraints + a->number_of_ratings + a->number_of_children) * sizeof(dpop_table_t *));
+
+	message_t *msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_START);
+	bool stop = dpop_message(msg)->type == DPOP_END;
+	message_free(msg);
+
+	// domains are exchanged between neighbors, constraints are rated over them
+	if (!stop) {
+		load_domain(a);
+
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			agent_send(a->agent, n->agent, create_domain_message(a));
+		}
+	}
+
+	for (int i = 0; !stop && i < a->agent->number_of_neighbors; i++) {
+		msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_DOMAIN);
+		stop = dpop_message(msg)->type == DPOP_END;
+		if (!stop) {
+			add_domain(a, msg->from, dpop_message(msg));
+		}
+		message_free(msg);
+	}
+
+	if (!stop) {
+		for_each_entry(dpop_constraint_t, dc, &a->constraints) {
+			dpop_table_t *t = rate_constraint(a, dc, context);
+
+			if (dc->deepest == a->agent) {
+				a->tables[a->number_of_tables++] = t;
+			} else {
+				message_t *msg = dpop_message_new(a, DPOP_RATING, get_table_size(t));
+				dpop_message(msg)->table = t;
+				agent_send(a->agent, dc->deepest, msg);
+			}
+		}
+	}
+
+	for (int i = 0; !stop && i < a->number_of_ratings; i++) {
+		msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_RATING);
+		stop = dpop_message(msg)->type == DPOP_END;
+		if (!stop) {
+			add_table(a, dpop_message(msg));
+		}
+		message_free(msg);
+	}
+
+	// UTIL propagation
+	for (int i = 0; !stop && i < a->number_of_children; i++) {
+		msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_UTIL);
+		stop = dpop_message(msg)->type == DPOP_END;
+		if (!stop) {
+			add_table(a, dpop_message(msg));
+		}
+		message_free(msg);
+	}
+
+	if (!stop) {
+		compute_util(a, context);
+
+		DEBUG_MESSAGE(a, "UTIL table with %zu entries (%zu bytes), separator %i, cut %i\n", a->util_size, a->util_size * sizeof(double), a->number_of_separators, a->number_of_cuts);
+
+		if (a->parent) {
+			message_t *msg = dpop_message_new(a, DPOP_UTIL, get_table_size(a->util));
+			dpop_message(msg)->table = a->util;
+			a->util = NULL;
+			agent_send(a->agent, a->parent->agent, msg);
+
+			msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_VALUE);
+			stop = dpop_message(msg)->type == DPOP_END;
+			if (!stop) {
+				memcpy(context, dpop_message(msg)->context, context_size);
+			}
+			message_free(msg);
+		}
+	}
+
+	// VALUE propagation
+	if (!stop) {
+		a->best = get_best_value(a, context, &a->value);
+		context[a->agent->id] = a->value;
+
+		for (int i = 0; i < a->number_of_children; i++) {
+			message_t *msg = dpop_message_new(a, DPOP_VALUE, context_size);
+			dpop_message(msg)->context = (int *) tlm_malloc(a->agent->tlm, context_size);
+			memcpy(dpop_message(msg)->context, context, context_size);
+			agent_send(a->agent, a->children[i]->agent, msg);
+		}
+
+		view_copy(a->agent->view, a->own[a->value]);
+
+		// the final assignments are exchanged, so views stay consistent
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			message_t *msg = dpop_message_new(a, DPOP_FINAL, 0);
+			dpop_message(msg)->view = view_clone(a->own[a->value]);
+			agent_send(a->agent, n->agent, msg);
+		}
+
+		for (int i = 0; i < a->agent->number_of_neighbors; i++) {
+			msg = agent_recv_filter(a->agent, filter_dpop_message, (void *) DPOP_FINAL);
+			if (dpop_message(msg)->type == DPOP_END) {
+				message_free(msg);
+				break;
+			}
+
+			merge_final_view(a, msg->from, dpop_message(msg)->view);
+
+			message_free(msg);
+		}
+	} else {
+		// other agents may wait for this one, parent and children aren't necessarily neighbors
+		for (int i = 0; i < a->number_of_links; i++) {
+			agent_send(a->agent, a->links[i]->agent, dpop_message_new(a, DPOP_END, 0));
+		}
+	}
+
+	tlm_free(a->agent->tlm, context);
+
+	dcop_stop_ROI(a->agent);
+
+	return (void *) a;
+}
+
+static void dpop_usage() {
+	printf("\n");
+	printf("OPTIONS:\n");
+	printf("	--memory KB, -m KB\n");
+	printf("		maximum size of a UTIL table, separator agents are cut if exceeded\n");
+	printf("\n");
+	printf("	--domain MAX, -d MAX\n");
+	printf("		maximum number of assignments in the domain of an agent\n");
+	printf("\n");
+	printf("	--candidates MAX, -c MAX\n");
+	printf("		maximum number of resources considered by an agent (up to %i)\n", DPOP_MAX_CANDIDATES);
+	printf("\n");
+}
+
+static int parse_arguments(int argc, char **argv) {
+	struct option long_options[] = {
+		{ "memory", required_argument, NULL, 'm' },
+		{ "domain", required_argument, NULL, 'd' },
+		{ "candidates", required_argument, NULL, 'c' },
+		{ 0 }
+	};
+
+	optind = 1;
+
+	while (true) {
+		int result = getopt_long(argc, argv, "m:d:c:", long_options, NULL);
+		if (result == -1) {
+			break;
+		}
+
+		long kb;
+		int n;
+
+		switch (result) {
+			case 'm':
+				kb = strtol(optarg, NULL, 10);
+				if (kb <= 0) {
+					print_error("dpop: invalid memory bound given\n");
+					print("dpop: using default memory bound %zu KB\n", memory_bound / 1024);
+				} else {
+					memory_bound = kb * 1024;
+					print("dpop: memory bound set to %zu KB\n", memory_bound / 1024);
+				}
+				break;
+
+			case 'd':
+				n = (int) strtol(optarg, NULL, 10);
+				if (n <= 0) {
+					print_error("dpop: invalid domain size given\n");
+					print("dpop: using default domain size %i\n", max_domain);
+				} else {
+					max_domain = n;
+					print("dpop: domain size set to %i\n", max_domain);
+				}
+				break;
+
+			case 'c':
+				n = (int) strtol(optarg, NULL, 10);
+				if (n <= 0 || n > DPOP_MAX_CANDIDATES) {
+					print_error("dpop: invalid number of candidate resources given\n");
+					print("dpop: using default number of candidate resources %i\n", max_candidates);
+				} else {
+					max_candidates = n;
+					print("dpop: number of candidate resources set to %i\n", max_candidates);
+				}
+				break;
+
+			case '?':
+			case ':':
+			default:
+				print_error("dpop: failed to parse algorithm paramters\n");
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void dpop_init(dcop_t *dcop, int argc, char **argv) {
+	parse_arguments(argc, argv);
+
+	agents = (dpop_agent_t **) calloc(dcop->number_of_agents + 1, sizeof(dpop_agent_t *));
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		dpop_agent_t *_a = (dpop_agent_t *) tlm_malloc(a->tlm, sizeof(dpop_agent_t));
+
+		_a->agent = a;
+		_a->links = (dpop_agent_t **) tlm_malloc(a->tlm, dcop->number_of_agents * sizeof(dpop_agent_t *));
+		_a->children = (dpop_agent_t **) tlm_malloc(a->tlm, dcop->number_of_agents * sizeof(dpop_agent_t *));
+		INIT_LIST_HEAD(&_a->constraints);
+
+		agents[a->id] = _a;
+	}
+
+	failed = false;
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		if (!load_constraints(agents[a->id])) {
+			failed = true;
+		}
+	}
+
+	// agents with the most links are the roots of the pseudo-trees
+	while (true) {
+		dpop_agent_t *root = NULL;
+
+		for_each_entry(agent_t, a, &dcop->agents) {
+			dpop_agent_t *_a = agents[a->id];
+
+			if (!_a->visited && (!root || _a->number_of_links > root->number_of_links)) {
+				root = _a;
+			}
+		}
+
+		if (!root) {
+			break;
+		}
+
+		build_pseudo_tree(root, NULL, 0);
+	}
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		if (!failed && !assign_constraints(agents[a->id])) {
+			failed = true;
+		}
+	}
+
+	if (failed) {
+		print_error("dpop: constraints can't be rated, not solving\n");
+	}
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_create_thread(a, dpop, agents[a->id]);
+	}
+	DEBUG print("\n");
+}
+
+static void dpop_cleanup(dcop_t *dcop) {
+	double total_initial_eval = 0;
+	double total_eval = 0;
+	double optimum = 0;
+	size_t max_table = 0;
+	unsigned long messages = 0;
+	size_t bytes = 0;
+	int cuts = 0;
+	bool complete = true;
+	size_t pruned = 0;
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		dpop_agent_t *_a = (dpop_agent_t *) agent_cleanup_thread(a);
+
+		_a->eval = agent_evaluate(a);
+
+		DEBUG_MESSAGE(_a, "initial utility: %f\n", _a->initial_eval);
+		DEBUG_MESSAGE(_a, "current utility: %f\n", _a->eval);
+		DEBUG_MESSAGE(_a, "depth: %i, children: %i, separator: %i (%i cut)\n", _a->depth, _a->number_of_children, _a->number_of_separators, _a->number_of_cuts);
+		DEBUG_MESSAGE(_a, "domain size: %i (%zu feasible assignments pruned%s), UTIL table: %zu entries (%zu bytes)\n", _a->domain_size, _a->pruned, _a->complete ? "" : ", incomplete", _a->util_size, _a->util_size * sizeof(double));
+		DEBUG_MESSAGE(_a, "messages sent: %lu (%lu bytes)\n", a->messages_sent, a->bytes_sent);
+
+		total_initial_eval += _a->initial_eval;
+		total_eval += _a->eval;
+		if (!_a->parent) {
+			optimum += _a->best;
+		}
+		max_table = _a->util_size * sizeof(double) > max_table ? _a->util_size * sizeof(double) : max_table;
+		messages += a->messages_sent;
+		bytes += a->bytes_sent;
+		cuts += _a->number_of_cuts;
+		pruned += _a->pruned;
+		if (!_a->complete) {
+			complete = false;
+		}
+	}
+	DEBUG print("\n");
+
+	DEBUG print("total initial utility: %f\n", total_initial_eval);
+	DEBUG print("total current utility: %f\n", total_eval);
+	if (failed) {
+		DEBUG print("no utility computed\n");
+	} else {
+		// only optimal with respect to the domains if not every resource was a candidate or assignments were pruned
+		DEBUG print("%s utility: %f\n", cuts > 0 ? "approximated" : complete ? "optimal" : "domain-restricted", optimum);
+	}
+	DEBUG print("total feasible assignments pruned: %zu\n", pruned);
+	DEBUG print("largest UTIL table: %zu bytes\n", max_table);
+	DEBUG print("total messages sent: %lu (%lu bytes)\n", messages, bytes);
+	DEBUG print("\n");
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		dpop_agent_t *_a = agents[a->id];
+
+		for_each_entry_safe(dpop_constraint_t, dc, _dc, &_a->constraints) {
+			list_del(&dc->_l);
+			tlm_free(a->tlm, dc->scope);
+			tlm_free(a->tlm, dc);
+		}
+
+		for (int i = 0; i < _a->number_of_tables; i++) {
+			dpop_table_free(_a->tables[i]);
+		}
+
+		if (_a->util) {
+			dpop_table_free(_a->util);
+		}
+
+		for_each_entry(neighbor_t, n, &a->neighbors) {
+			if (_a->domains && _a->domains[n->agent->id].foreign) {
+				dpop_domain_free(a->tlm, _a->domains[n->agent->id].foreign, _a->domains[n->agent->id].size);
+			}
+		}
+
+		for (int i = 0; i < _a->domain_size; i++) {
+			view_free(_a->own[i]);
+			view_free(_a->foreign[i]);
+		}
+
+		if (_a->own) {
+			tlm_free(a->tlm, _a->own);
+			tlm_free(a->tlm, _a->foreign);
+		}
+		if (_a->domains) {
+			tlm_free(a->tlm, _a->domains);
+		}
+		if (_a->tables) {
+			tlm_free(a->tlm, _a->tables);
+		}
+		tlm_free(a->tlm, _a->links);
+		tlm_free(a->tlm, _a->children);
+
+		tlm_free(a->tlm, _a);
+	}
+
+	free(agents);
+	agents = NULL;
+}
+
+static void dpop_run(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, dpop_message_new(NULL, failed ? DPOP_END : DPOP_START, 0));
+	}
+}
+
+static void dpop_kill(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, dpop_message_new(NULL, DPOP_END, 0));
+	}
+}
+
+void dpop_register() {
+	_dpop = algorithm_new("dpop", dpop_init, dpop_cleanup, dpop_run, dpop_kill, dpop_usage);
+	dcop_register_algorithm(&_dpop);
+}
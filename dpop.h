@@ -0,0 +1,6 @@
+#ifndef DPOP_H_
+#define DPOP_H_
+
+void dpop_register();
+
+#endif /* DPOP_H_ */
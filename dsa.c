@@ -0,0 +1,519 @@
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent.h"
+#include "algorithm.h"
+#include "console.h"
+#include "dcop.h"
+#include "dsa.h"
+#include "list.h"
+#include "mgm.h"
+#include "resource.h"
+#include "view.h"
+
+/*
+ * DSA: agents only exchange their views. Every round an agent searches its
+ * best assignment and moves there with a certain probability. Neighbors may
+ * move in the same round, conflicting claims are resolved in favour of the
+ * agent with the lowest id.
+ */
+
+typedef enum {
+	DSA_A,
+	DSA_B,
+	DSA_C
+} dsa_variant_t;
+
+typedef struct dsa_message {
+	enum {
+		DSA_OK,
+		DSA_END,
+		DSA_START
+	} type;
+	view_t *view;
+	int round;
+	bool moved;
+	double gain;
+} dsa_message_t;
+
+typedef struct dsa_agent {
+	mgm_agent_t mgm;
+	agent_t *agent;
+	struct random_data buf;
+	char statebuf[32];
+	bool moved;
+	double gain;
+	int moves;
+} dsa_agent_t;
+
+static algorithm_t _dsa;
+
+static int max_rounds = 200;
+static double activation = 0.7;
+static dsa_variant_t variant = DSA_B;
+
+#define dsa_message(m) ((dsa_message_t *) m->buf)
+
+#define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
+
+static void dsa_message_free(tlm_t *tlm, void *buf) {
+	dsa_message_t *msg = (dsa_message_t *) buf;
+
+	if (msg) {
+		if (msg->view) {
+			view_free(msg->view);
+		}
+
+		tlm_free(tlm, msg);
+	}
+}
+
+static message_t * dsa_message_new(dsa_agent_t *a, int type) {
+	tlm_t *tlm = a ? a->agent->tlm : NULL;
+
+	dsa_message_t *msg = (dsa_message_t *) tlm_malloc(tlm, sizeof(dsa_message_t));
+	msg->type = type;
+
+	return message_new(tlm, msg, sizeof(dsa_message_t), dsa_message_free);
+}
+
+static double random_d(dsa_agent_t *a) {
+	int32_t i;
+	random_r(&a->buf, &i);
+
+	return (double) i / RAND_MAX;
+}
+
+// OK messages of faster neighbors are kept until their round is reached
+static bool filter_dsa_message(message_t *msg, void *round) {
+	return dsa_message(msg)->type != DSA_OK || dsa_message(msg)->round == (long) round;
+}
+
+static void send_end(dsa_agent_t *a, agent_t *except) {
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		if (n->agent != except) {
+			agent_send(a->agent, n->agent, dsa_message_new(a, DSA_END));
+		}
+	}
+}
+
+/*
+ * applies the moves of the agent and its neighbors to the view of the previous
+ * round. An agent that loses any claim to an agent with a lower id is rolled
+ * back as a whole, it would otherwise end up in an assignment it never rated.
+ */
+static void reconcile(dsa_agent_t *a, view_t *prev, bool moved[]) {
+	int n = a->agent->dcop->hardware->number_of_resources;
+
+	resource_t *resources[n];
+	int claim[n];
+	bool yield[n];
+
+	for_each_entry(resource_t, r, &prev->resources) {
+		resources[r->index] = r;
+	}
+
+	// the agent itself first, then its neighbors
+	int k = a->agent->number_of_neighbors + 1;
+	agent_t *agents[k];
+	view_t *views[k];
+
+	agents[0] = a->agent;
+	views[0] = a->agent->view;
+
+	int i = 1;
+	for_each_entry(neighbor_t, _n, &a->agent->neighbors) {
+		agents[i] = _n->agent;
+		views[i] = a->agent->agent_view[_n->agent->id];
+		i++;
+	}
+
+	bool rolled_back[k];
+	memset(rolled_back, 0, sizeof(rolled_back));
+
+	// the agent with the lowest id never loses a claim, so this terminates
+	bool changed = true;
+	while (changed) {
+		changed = false;
+
+		for (int j = 0; j < n; j++) {
+			claim[j] = -1;
+			yield[j] = false;
+		}
+
+		for (i = 0; i < k; i++) {
+			if (!moved[i] || rolled_back[i]) {
+				continue;
+			}
+
+			for_each_entry(resource_t, r, &views[i]->resources) {
+				bool owned = resource_get_owner(r) == agents[i]->id;
+				bool owned_before = resource_get_owner(resources[r->index]) == agents[i]->id;
+
+				if (owned && !owned_before && (claim[r->index] < 0 || agents[i]->id < claim[r->index])) {
+					claim[r->index] = agents[i]->id;
+				} else if (!owned && owned_before) {
+					yield[r->index] = true;
+				}
+			}
+		}
+
+		for (i = 0; i < k; i++) {
+			if (!moved[i] || rolled_back[i]) {
+				continue;
+			}
+
+			for_each_entry(resource_t, r, &views[i]->resources) {
+				bool owned = resource_get_owner(r) == agents[i]->id;
+				bool owned_before = resource_get_owner(resources[r->index]) == agents[i]->id;
+
+				if (owned && !owned_before && claim[r->index] != agents[i]->id) {
+					if (i == 0) {
+						DEBUG_MESSAGE(a, "lost core %i to agent %i, rolling back move\n", r->index, claim[r->index]);
+					}
+
+					rolled_back[i] = true;
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for_each_entry(resource_t, r, &prev->resources) {
+		if (claim[r->index] >= 0) {
+			r->status = RESOURCE_STATUS_TAKEN;
+			r->owner = claim[r->index];
+		} else if (yield[r->index]) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+
+	view_copy(a->agent->view, prev);
+}
+
+// an assignment with the same rating but more resources
+static view_t * lateral_move(dsa_agent_t *a) {
+	mgm_agent_t s = a->mgm;
+
+	s.new_view = view_clone(a->agent->view);
+	s.best_eval = -1;
+	s.max_resources = -1;
+
+	mgm_find_assignment(&s);
+
+	if (s.improve == 0 && !view_compare(s.new_view, a->agent->view)) {
+		return s.new_view;
+	}
+
+	view_free(s.new_view);
+
+	return NULL;
+}
+
+static void decide(dsa_agent_t *a) {
+	a->moved = false;
+
+	a->mgm.eval = agent_evaluate(a->agent);
+
+	// IMPROVEMENT: don't try to improve when already at optimal utility
+	if (a->mgm.eval == a->mgm.best_eval) {
+		a->gain = 0;
+		return;
+	}
+
+	mgm_find_assignment(&a->mgm);
+
+	a->gain = a->mgm.improve;
+
+	if (a->gain > 0) {
+		a->moved = random_d(a) < activation;
+	} else if (variant == DSA_C || (variant == DSA_B && a->mgm.eval > a->mgm.best_eval)) {
+		view_t *view = lateral_move(a);
+
+		if (view) {
+			view_copy(a->mgm.new_view, view);
+			view_free(view);
+
+			a->moved = random_d(a) < activation;
+		}
+	}
+
+	if (a->moved) {
+		a->moves++;
+	}
+}
+
+static void * dsa(void *arg) {
+	dsa_agent_t *a = (dsa_agent_t *) arg;
+
+	tlm_touch(a->agent->tlm);
+
+	dcop_start_ROI(a->agent);
+
+	mgm_setup(&a->mgm);
+
+	// no OK message is tagged with round -1
+	message_t *msg = agent_recv_filter(a->agent, filter_dsa_message, (void *) -1L);
+	bool stop = dsa_message(msg)->type == DSA_END;
+	message_free(msg);
+
+	if (!stop && !agent_has_neighbors(a->agent)) {
+		decide(a);
+		if (a->gain > 0) {
+			view_copy(a->agent->view, a->mgm.new_view);
+		}
+		stop = true;
+	}
+
+	view_t *prev = view_clone(a->agent->view);
+
+	while (!stop) {
+		view_copy(prev, a->agent->view);
+
+		if (a->moved) {
+			view_copy(a->agent->view, a->mgm.new_view);
+		}
+
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			message_t *msg = dsa_message_new(a, DSA_OK);
+			dsa_message(msg)->view = view_clone(a->agent->view);
+			dsa_message(msg)->round = a->mgm.rounds;
+			dsa_message(msg)->moved = a->moved;
+			dsa_message(msg)->gain = a->gain;
+			agent_send(a->agent, n->agent, msg);
+		}
+
+		// moved[0] refers to the agent itself
+		bool moved[a->agent->number_of_neighbors + 1];
+		moved[0] = a->moved;
+
+		bool stale = a->mgm.rounds > 0 && !a->moved && a->gain <= 0;
+
+		for (int i = 0; i < a->agent->number_of_neighbors; i++) {
+			message_t *msg = agent_recv_filter(a->agent, filter_dsa_message, (void *) (long) a->mgm.rounds);
+
+			if (dsa_message(msg)->type == DSA_END) {
+				// the end is propagated, otherwise agents further away would wait forever
+				send_end(a, msg->from);
+
+				message_free(msg);
+
+				stop = true;
+				break;
+			}
+
+			view_copy(a->agent->agent_view[msg->from->id], dsa_message(msg)->view);
+
+			int j = 1;
+			for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+				if (n->agent == msg->from) {
+					moved[j] = dsa_message(msg)->moved;
+					break;
+				}
+				j++;
+			}
+
+			if (dsa_message(msg)->moved || dsa_message(msg)->gain > 0) {
+				stale = false;
+			}
+
+			message_free(msg);
+		}
+
+		if (stop) {
+			break;
+		}
+
+		reconcile(a, prev, moved);
+
+		if (++a->mgm.rounds == max_rounds || stale) {
+			if (stale) {
+				DEBUG_MESSAGE(a, "stopping algorithm due to stale resource assignment\n");
+			}
+
+			send_end(a, NULL);
+			break;
+		}
+
+		decide(a);
+
+		agent_clear_agent_view(a->agent);
+	}
+
+	view_free(prev);
+
+	a->mgm.eval = agent_evaluate(a->agent);
+
+	dcop_stop_ROI(a->agent);
+
+	return (void *) a;
+}
+
+static void dsa_usage() {
+	printf("\n");
+	printf("OPTIONS:\n");
+	printf("	--rounds MAX, -r MAX\n");
+	printf("		maximum number of rounds\n");
+	printf("\n");
+	printf("	--activation PROBABILITY, -p PROBABILITY\n");
+	printf("		probability of an agent to move to a better assignment\n");
+	printf("\n");
+	printf("	--variant VARIANT, -v VARIANT\n");
+	printf("		A (only improving moves), B (default, lateral moves if not optimal), C (lateral moves)\n");
+	printf("\n");
+}
+
+static int parse_arguments(int argc, char **argv) {
+	struct option long_options[] = {
+		{ "rounds", required_argument, NULL, 'r' },
+		{ "activation", required_argument, NULL, 'p' },
+		{ "variant", required_argument, NULL, 'v' },
+		{ 0 }
+	};
+
+	optind = 1;
+
+	while (true) {
+		int result = getopt_long(argc, argv, "r:p:v:", long_options, NULL);
+		if (result == -1) {
+			break;
+		}
+
+		int rounds;
+		double probability;
+
+		switch (result) {
+			case 'r':
+				rounds = (int) strtol(optarg, NULL, 10);
+				if (rounds <= 0) {
+					print_error("dsa: invalid number of rounds given\n");
+					print("dsa: using default number of rounds %i\n", max_rounds);
+				} else {
+					max_rounds = rounds;
+					print("dsa: number of rounds set to %i\n", max_rounds);
+				}
+				break;
+
+			case 'p':
+				probability = strtod(optarg, NULL);
+				if (probability <= 0 || probability > 1) {
+					print_error("dsa: invalid activation probability given\n");
+					print("dsa: using default activation probability %f\n", activation);
+				} else {
+					activation = probability;
+					print("dsa: activation probability set to %f\n", activation);
+				}
+				break;
+
+			case 'v':
+				if (!strcasecmp(optarg, "A")) {
+					variant = DSA_A;
+				} else if (!strcasecmp(optarg, "B")) {
+					variant = DSA_B;
+				} else if (!strcasecmp(optarg, "C")) {
+					variant = DSA_C;
+				} else {
+					print_error("dsa: invalid variant given\n");
+					print("dsa: using default variant\n");
+					break;
+				}
+				print("dsa: variant set to %s\n", optarg);
+				break;
+
+			case '?':
+			case ':':
+			default:
+				print_error("dsa: failed to parse algorithm paramters\n");
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void dsa_init(dcop_t *dcop, int argc, char **argv) {
+	parse_arguments(argc, argv);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		dsa_agent_t *_a = (dsa_agent_t *) tlm_malloc(a->tlm, sizeof(dsa_agent_t));
+
+		_a->agent = a;
+		_a->mgm.agent = a;
+
+		unsigned int seed = dcop_get_seed() + a->id;
+		initstate_r(seed, _a->statebuf, sizeof(_a->statebuf), &_a->buf);
+		srandom_r(seed, &_a->buf);
+
+		agent_create_thread(a, dsa, _a);
+	}
+	DEBUG print("\n");
+}
+
+static void dsa_cleanup(dcop_t *dcop) {
+	double total_initial_eval = 0;
+	double total_eval = 0;
+	int rounds = 0;
+	unsigned long messages = 0;
+	size_t bytes = 0;
+	int moves = 0;
+	bool consistent = true;
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		dsa_agent_t *_a = (dsa_agent_t *) agent_cleanup_thread(a);
+
+		if (_a->mgm.eval == INFINITY) {
+			DEBUG_MESSAGE(_a, "finished with eval %f\n", _a->mgm.eval);
+			consistent = false;
+		}
+
+		DEBUG_MESSAGE(_a, "initial utility: %f\n", _a->mgm.initial_eval);
+		DEBUG_MESSAGE(_a, "current utility: %f\n", _a->mgm.eval);
+		DEBUG_MESSAGE(_a, "rounds: %i\n", _a->mgm.rounds);
+		DEBUG_MESSAGE(_a, "messages sent: %lu (%lu bytes)\n", a->messages_sent, a->bytes_sent);
+		DEBUG_MESSAGE(_a, "moves: %i\n", _a->moves);
+
+		total_initial_eval += _a->mgm.initial_eval;
+		total_eval += _a->mgm.eval;
+		rounds = _a->mgm.rounds > rounds ? _a->mgm.rounds : rounds;
+		messages += a->messages_sent;
+		bytes += a->bytes_sent;
+		moves += _a->moves;
+
+		view_free(_a->mgm.new_view);
+
+		tlm_free(a->tlm, _a);
+	}
+	DEBUG print("\n");
+
+	DEBUG print("total initial utility: %f\n", total_initial_eval);
+	DEBUG print("total current utility: %f\n", total_eval);
+	DEBUG print("rounds: %i\n", rounds);
+	DEBUG print("total messages sent: %lu (%lu bytes)\n", messages, bytes);
+	DEBUG print("total moves: %i\n", moves);
+	DEBUG print("\n");
+
+	if (!consistent) print_error("error: DSA algorithm finished in an incosistent state\n");
+}
+
+static void dsa_run(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, dsa_message_new(NULL, DSA_START));
+	}
+}
+
+static void dsa_kill(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, dsa_message_new(NULL, DSA_END));
+	}
+}
+
+void dsa_register() {
+	_dsa = algorithm_new("dsa", dsa_init, dsa_cleanup, dsa_run, dsa_kill, dsa_usage);
+	dcop_register_algorithm(&_dsa);
+}
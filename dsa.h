@@ -0,0 +1,6 @@
+#ifndef DSA_H_
+#define DSA_H_
+
+void dsa_register();
+
+#endif /* DSA_H_ */
@@ -1,18 +1,68 @@
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <lua.h>
 
 #include "hardware.h"
+#include "resource.h"
 #include "view.h"
 
 void hardware_free(hardware_t *hw) {
 	if (hw) {
 		view_free(hw->view);
 
+		free(hw->x);
+		free(hw->y);
+		free(hw->hops);
+
 		free(hw);
 	}
 }
 
+static int hop_distance(int a, int b, int n, bool wrap_around) {
+	int d = abs(a - b);
+
+	return (wrap_around && n - d < d ? n - d : d);
+}
+
+static void hardware_load_topology(lua_State *L, hardware_t *hw) {
+	int n = hw->number_of_tiles + 1;
+
+	hw->x = calloc(n, sizeof(int));
+	hw->y = calloc(n, sizeof(int));
+
+	for (int t = 1; t < n; t++) {
+		lua_rawgeti(L, -1, t);
+
+		lua_getfield(L, -1, "x");
+		hw->x[t] = lua_tonumber(L, -1);
+		lua_getfield(L, -2, "y");
+		hw->y[t] = lua_tonumber(L, -1);
+
+		lua_pop(L, 3);
+
+		if (hw->x[t] + 1 > hw->width) {
+			hw->width = hw->x[t] + 1;
+		}
+		if (hw->y[t] + 1 > hw->height) {
+			hw->height = hw->y[t] + 1;
+		}
+	}
+
+	lua_getfield(L, -2, "wrap_around");
+	hw->wrap_around = lua_toboolean(L, -1);
+	lua_pop(L, 1);
+
+	// hop distances are precomputed once so lookups during the search are cheap
+	hw->hops = calloc(n * n, sizeof(int));
+
+	for (int t = 1; t < n; t++) {
+		for (int u = 1; u < n; u++) {
+			hw->hops[t * n + u] = hop_distance(hw->x[t], hw->x[u], hw->width, hw->wrap_around) + hop_distance(hw->y[t], hw->y[u], hw->height, hw->wrap_around);
+		}
+	}
+}
+
 void hardware_load(lua_State *L, hardware_t *hw) {
 	lua_getfield(L, -1, "number_of_tiles");
 	hw->number_of_tiles = lua_tonumber(L, -1);
@@ -21,6 +71,61 @@ void hardware_load(lua_State *L, hardware_t *hw) {
 	hw->view = view_new();
 	hw->number_of_resources = view_load(L, hw->view);
 
-	lua_pop(L, 3);
+	lua_pop(L, 2);
+
+	lua_getfield(L, -1, "coordinates");
+	if (lua_istable(L, -1)) {
+		hardware_load_topology(L, hw);
+	}
+
+	lua_pop(L, 2);
+}
+
+// without a topology tiles are assumed to form a line
+int hardware_get_hops(hardware_t *hw, int t, int u) {
+	if (!hw->hops) {
+		return abs(t - u);
+	}
+
+	return hw->hops[t * (hw->number_of_tiles + 1) + u];
+}
+
+// without a topology the distance is measured along the list of resources
+int hardware_get_distance(hardware_t *hw, resource_t *r, resource_t *s) {
+	if (!hw->hops) {
+		return abs(r->index - s->index);
+	}
+
+	return hardware_get_hops(hw, r->tile, s->tile);
 }
 
+// orders tiles so that each consecutive group of size tiles is close on the NoC
+void hardware_group_tiles(hardware_t *hw, int size, int *tiles) {
+	int n = hw->number_of_tiles;
+
+	bool *grouped = calloc(n + 1, sizeof(bool));
+
+	int k = 0;
+	for (int seed = 1; seed <= n; seed++) {
+		if (grouped[seed]) {
+			continue;
+		}
+
+		grouped[seed] = true;
+		tiles[k++] = seed;
+
+		for (int j = 1; j < size && k < n; j++) {
+			int nearest = 0;
+			for (int t = 1; t <= n; t++) {
+				if (!grouped[t] && (!nearest || hardware_get_hops(hw, seed, t) < hardware_get_hops(hw, seed, nearest))) {
+					nearest = t;
+				}
+			}
+
+			grouped[nearest] = true;
+			tiles[k++] = nearest;
+		}
+	}
+
+	free(grouped);
+}
@@ -1,18 +1,28 @@
 #ifndef HARDWARE_H_
 #define HARDWARE_H_
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <lua.h>
 
 typedef struct hardware hardware_t;
 
+#include "resource.h"
 #include "view.h"
 
 struct hardware {
 	int number_of_tiles;
 	int number_of_resources;
 	view_t *view;
+	// optional NoC topology, indexed by tile (tiles start at 1)
+	int *x;
+	int *y;
+	int width;
+	int height;
+	bool wrap_around;
+	// hop distance between tiles t and u at hops[t * (number_of_tiles + 1) + u]
+	int *hops;
 };
 
 #define hardware_new() (hardware_t *) calloc(1, sizeof(hardware_t))
@@ -21,5 +31,10 @@ void hardware_free(hardware_t *hw);
 
 void hardware_load(lua_State *L, hardware_t *hw);
 
-#endif /* HARDWARE_H_ */
+int hardware_get_hops(hardware_t *hw, int t, int u);
+
+int hardware_get_distance(hardware_t *hw, resource_t *r, resource_t *s);
 
+void hardware_group_tiles(hardware_t *hw, int size, int *tiles);
+
+#endif /* HARDWARE_H_ */
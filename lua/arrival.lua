@@ -0,0 +1,18 @@
+local dcop = require("dcop")
+local constraint = require("constraint")
+
+-- attaches an agent to a running dcop in service mode (add lua/arrival.lua)
+
+local problem = __dcop
+
+local agent = dcop.agent.new()
+
+agent:add_constraint(constraint.create("TYPE", { "REGULAR", 2, 2 }))
+
+for _, a in ipairs(problem.agents) do
+	if not a.vacant then
+		agent:add_constraint(constraint.create("SHARE", { a }))
+	end
+end
+
+problem:attach(agent)
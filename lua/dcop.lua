@@ -113,6 +113,29 @@ hardware.new = function(t, n)
 		end
 	end
 
+	-- places tiles row by row on a 2-D mesh of the given width (a width of
+	-- number_of_tiles gives a line, or a ring with wrap_around)
+	hw.set_mesh = function(this, width, wrap_around)
+		check_object_type(this, "hardware")
+		base.assert(base.type(width) == "number" and width > 0, "argument 'width' must be a positive number")
+
+		this.coordinates = {}
+		for t = 1, this.number_of_tiles do
+			this.coordinates[t] = { x = (t - 1) % width, y = math.floor((t - 1) / width) }
+		end
+
+		this.wrap_around = wrap_around and true or false
+	end
+
+	hw.set_coordinates = function(this, t, x, y)
+		check_object_type(this, "hardware")
+		base.assert(t > 0 and t <= this.number_of_tiles, "unknown tile " .. t)
+		base.assert(base.type(x) == "number" and base.type(y) == "number", "coordinates must be numbers")
+
+		this.coordinates = this.coordinates or {}
+		this.coordinates[t] = { x = x, y = y }
+	end
+
 	hw.get_tile = function(this, t)
 		check_object_type(this, "hardware")
 		base.assert(t > 0 and t <= this.number_of_tiles, "unknown tile " .. t)
@@ -189,6 +212,41 @@ agent.new = function()
 		table.insert(this.constraints, c)
 	end
 
+	-- removes neighbor id and every constraint referring to it (service mode)
+	a.drop_neighbor = function(this, id)
+		check_object_type(this, "agent")
+
+		local references
+		references = function(c)
+			for _, n in base.ipairs(c.param.neighbors) do
+				if n == id or (typeof(n) == "agent" and n.id == id) then
+					return true
+				end
+			end
+			for _, arg in base.ipairs(c.param.args) do
+				if typeof(arg) == "constraint" and references(arg) then
+					return true
+				end
+			end
+			return false
+		end
+
+		for i = table.maxn(this.constraints), 1, -1 do
+			if references(this.constraints[i]) then
+				table.remove(this.constraints, i)
+			end
+		end
+
+		for i, j in base.ipairs(this.neighbors) do
+			if j == id then
+				table.remove(this.neighbors, i)
+				break
+			end
+		end
+
+		this.agent_view[id] = nil
+	end
+
 	a.rate_view = function(this)
 		check_object_type(this, "agent")
 
@@ -349,30 +407,34 @@ function new(hw, n)
 		return base.unpack(this.agents, start)
 	end
 
-	p.load = function(this)
-		check_object_type(this, "dcop")
-
-		for _, a in base.ipairs(this.agents) do
-			for _, c in base.pairs(a.constraints) do
-				local process_constraint
-				process_constraint = function(agent, constraint)
-					constraint.param.agent = agent
-					local _neighbors = {}
-					for _, n in base.ipairs(constraint.param.neighbors) do
-						if not contains(agent.neighbors, n.id) then
-							table.insert(agent.neighbors, n.id)
-						end
-						table.insert(_neighbors, n.id)
+	local process_constraints = function(a)
+		for _, c in base.pairs(a.constraints) do
+			local process_constraint
+			process_constraint = function(agent, constraint)
+				constraint.param.agent = agent
+				local _neighbors = {}
+				for _, n in base.ipairs(constraint.param.neighbors) do
+					if not contains(agent.neighbors, n.id) then
+						table.insert(agent.neighbors, n.id)
 					end
-					c.param.neighbors = _neighbors
-					for _, a in base.ipairs(constraint.param.args) do
-						if typeof(a) == "constraint" then
-							process_constraint(agent, a)
-						end
+					table.insert(_neighbors, n.id)
+				end
+				c.param.neighbors = _neighbors
+				for _, a in base.ipairs(constraint.param.args) do
+					if typeof(a) == "constraint" then
+						process_constraint(agent, a)
 					end
 				end
-				process_constraint(a, c)
 			end
+			process_constraint(a, c)
+		end
+	end
+
+	p.load = function(this)
+		check_object_type(this, "dcop")
+
+		for _, a in base.ipairs(this.agents) do
+			process_constraints(a)
 		end
 
 		for _, a in base.ipairs(this.agents) do
@@ -405,6 +467,81 @@ function new(hw, n)
 		end
 	end
 
+	-- attaches an agent with native constraints at run time (service mode)
+	p.attach = function(this, a)
+		check_object_type(this, "dcop")
+		check_object_type(a, "agent")
+
+		local id
+		for i, x in base.ipairs(this.agents) do
+			if x.vacant then
+				id = i
+				break
+			end
+		end
+		if id then
+			this.agents[id] = a
+			a.id = id
+		else
+			this:add_agent(a)
+		end
+
+		process_constraints(a)
+
+		for _, n in base.ipairs(a.neighbors) do
+			local x = this.agents[n]
+			if not contains(x.neighbors, a.id) then
+				table.insert(x.neighbors, a.id)
+			end
+			a.agent_view[n] = {}
+			x.agent_view[a.id] = {}
+		end
+
+		for i, r in base.ipairs(this.hardware.resources) do
+			if not a.view[i] then
+				a.view[i] = resource.new(r.type, r.tile)
+				a.view[i].status = r.status
+				a.view[i].owner = r.owner
+			end
+			for _, j in base.ipairs(a.neighbors) do
+				a.agent_view[j][i] = resource.new(r.type, r.tile)
+				a.agent_view[j][i].status = resource.status.UNKNOWN
+				this.agents[j].agent_view[a.id][i] = resource.new(r.type, r.tile)
+				this.agents[j].agent_view[a.id][i].status = resource.status.UNKNOWN
+			end
+		end
+
+		if not base.__dcop_attach then
+			base.print("error: __dcop_attach undefined")
+		elseif not base.__dcop_attach(this, a) then
+			this:detach(a.id)
+			return nil
+		end
+
+		return a.id, a
+	end
+
+	-- the id of a detached agent is kept until another agent is attached
+	p.detach = function(this, id)
+		check_object_type(this, "dcop")
+		base.assert(this.agents[id] and not this.agents[id].vacant, "unknown agent " .. base.tostring(id))
+
+		for _, n in base.ipairs(this.agents[id].neighbors) do
+			this.agents[n]:drop_neighbor(id)
+		end
+
+		for _, r in base.ipairs(this.hardware.resources) do
+			if r:is_owner(id) then
+				r.status = resource.status.FREE
+			end
+		end
+
+		local vacant = agent.new()
+		vacant.id = id
+		vacant.vacant = true
+		this.agents[id] = vacant
+	end
+
 	if n then
 		return p, p:create_agents(n)
 	end
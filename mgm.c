@@ -1,7 +1,9 @@
 #include <getopt.h>
+#include <limits.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,9 +11,15 @@
 #include "agent.h"
 #include "algorithm.h"
 #include "console.h"
+#include "constraint.h"
 #include "dcop.h"
+#include "hardware.h"
 #include "list.h"
+#include "mgm.h"
+#include "pool.h"
+#include "profile.h"
 #include "resource.h"
+#include "termination.h"
 #include "view.h"
 
 typedef struct mgm_message {
@@ -31,35 +39,82 @@ typedef struct mgm_message {
 	};
 } mgm_message_t;
 
-typedef struct mgm_agent {
-	int term;
-	bool can_move;
+// state shared by the tasks of a parallel subregion search
+typedef struct mgm_parallel {
+	pool_group_t group;
+	struct list_head tasks;
+	int number_of_tasks;
+	pthread_mutex_t m;
+	int stop;
+	double incumbent;
+} mgm_parallel_t;
+
+typedef struct mgm_record {
+	struct list_head _l;
+	view_t *view;
 	double eval;
-	double improve;
+} mgm_record_t;
+
+// a subtree of a subregion searched on a private copy of the agent's search state
+typedef struct mgm_task {
+	struct list_head _l;
+	mgm_agent_t a;
+	mgm_parallel_t *parallel;
+	int index;
+	int region;
+	resource_t *r;
+	int pos;
 	view_t *new_view;
-	agent_t *agent;
-	bool consistent;
-	bool stale;
-	bool changed;
-	double initial_eval;
-	double best_eval;
-	int max_resources;
-} mgm_agent_t;
+	double new_eval;
+	struct list_head records;
+} mgm_task_t;
 
 typedef enum {
 	MGM_WAIT_OK_MODE,
 	MGM_WAIT_IMPROVE_MODE
 } mgm_mode_t;
 
+typedef enum {
+	MGM_SEARCH_EXHAUSTIVE,
+	MGM_SEARCH_BNB,
+	MGM_SEARCH_GRAY
+} mgm_search_t;
+
 static algorithm_t _mgm;
 
 static int max_distance = 200;
 static int max_tiles = 2;
+static mgm_search_t search = MGM_SEARCH_EXHAUSTIVE;
+static int workers = 0;
+static bool deterministic = false;
+static bool quiescence = false;
+
+static pool_t *pool = NULL;
+
+// optimal utilities of agents, keyed by the signature of their constraints
+typedef struct mgm_cache_entry {
+	struct list_head _l;
+	uint64_t signature;
+	bool ready;
+	double best_eval;
+	int max_resources;
+} mgm_cache_entry_t;
+
+static LIST_HEAD(cache);
+static pthread_mutex_t cache_m = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cache_cv = PTHREAD_COND_INITIALIZER;
+static char *cache_file = NULL;
+static unsigned long cache_hits = 0;
+
+static termination_t *termination = NULL;
 
 static bool consistent = true;
 
 #define min(x, y) (x < y ? x : y)
 
+// partitions with more resources are searched recursively even in gray mode
+#define MGM_GRAY_MAX_RESOURCES 24
+
 #define mgm_message(m) ((mgm_message_t *) m->buf)
 
 #define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
@@ -102,14 +157,18 @@ static message_t * mgm_message_new(mgm_agent_t *a, int type) {
 }
 
 static int send_ok(mgm_agent_t *a) {
+	a->rounds++;
+
 	// IMPROVEMENT: stop algorithm if no agent has changed its resource assignment
-	if (++a->term == max_distance || a->stale) {
+	if (++a->term == max_distance || (a->stale && !quiescence)) {
 		if (a->stale) {
 			DEBUG_MESSAGE(a, "stopping algorithm due to stale resource assignment\n");
 		}
 
 		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
-			agent_send(a->agent, n->agent, mgm_message_new(a, MGM_END));
+			message_t *msg = mgm_message_new(a, MGM_END);
+			message_set_control(msg);
+			agent_send(a->agent, n->agent, msg);
 		}
 
 		return -1;
@@ -132,6 +191,22 @@ static int send_ok(mgm_agent_t *a) {
 	return 0;
 }
 
+double mgm_rate_improvement(mgm_agent_t *a, double _eval, double *eval) {
+	double improve;
+	if (!isfinite(_eval) && (eval ? !isfinite(*eval) : !isfinite(a->eval))) {
+		improve = 0;
+	} else if (!isfinite(_eval)) {
+		improve = -INFINITY;
+	} else {
+		improve = (eval ? *eval : a->eval) - _eval;
+		if (eval && improve > 0) {
+			*eval = _eval;
+		}
+	}
+
+	return improve;
+}
+
 static double get_improvement(mgm_agent_t *a, double *eval) {
 	double _eval;
 	if (a->new_view->size == a->agent->view->size) {
@@ -145,19 +220,76 @@ static double get_improvement(mgm_agent_t *a, double *eval) {
 		view_free(view);
 	}
 
-	double improve;
-	if (!isfinite(_eval) && (eval ? !isfinite(*eval) : !isfinite(a->eval))) {
-		improve = 0;
-	} else if (!isfinite(_eval)) {
-		improve = -INFINITY;
+	return mgm_rate_improvement(a, _eval, eval);
+}
+
+// rates the assignment with all resources from r onwards left undecided
+static double get_bound(mgm_agent_t *a, resource_t *r) {
+	int n = 0;
+	for (resource_t *_r = r; &_r->_l != &a->new_view->resources; _r = list_entry(_r->_l.next, resource_t, _l)) {
+		n++;
+	}
+
+	int status[n];
+
+	int i = 0;
+	for (resource_t *_r = r; &_r->_l != &a->new_view->resources; _r = list_entry(_r->_l.next, resource_t, _l)) {
+		status[i++] = _r->status;
+		_r->status = RESOURCE_STATUS_UNKNOWN;
+	}
+
+	double bound;
+	if (a->new_view->size == a->agent->view->size) {
+		bound = agent_bound_view(a->agent, a->new_view);
 	} else {
-		improve = (eval ? *eval : a->eval) - _eval;
-		if (eval && improve > 0) {
-			*eval = _eval;
-		}
+		view_t *view = view_clone(a->agent->view);
+		view_update(view, a->new_view);
+
+		bound = agent_bound_view(a->agent, view);
+
+		view_free(view);
 	}
 
-	return improve;
+	i = 0;
+	for (resource_t *_r = r; &_r->_l != &a->new_view->resources; _r = list_entry(_r->_l.next, resource_t, _l)) {
+		_r->status = status[i++];
+	}
+
+	return bound;
+}
+
+static bool can_prune(mgm_agent_t *a, resource_t *r, double *new_eval) {
+	double bound = get_bound(a, r);
+
+	double eval = *new_eval;
+	if (a->task && !deterministic) {
+		pthread_mutex_lock(&a->task->parallel->m);
+		eval = fmin(eval, a->task->parallel->incumbent);
+		pthread_mutex_unlock(&a->task->parallel->m);
+	}
+
+	// while searching for the optimal utility equally rated assignments may still replace the current one
+	if (a->best_eval < 0 || new_eval == &a->best_eval) {
+		return bound > eval;
+	} else {
+		return bound >= eval;
+	}
+}
+
+// tasks following a task that found an optimal assignment are obsolete
+#define task_is_obsolete(t) (t->index > __atomic_load_n(&t->parallel->stop, __ATOMIC_RELAXED))
+
+static void record_assignment(mgm_task_t *t, view_t *view, double eval, bool improve) {
+	mgm_record_t *rec = (mgm_record_t *) tlm_malloc(t->a.agent->tlm, sizeof(mgm_record_t));
+	rec->view = view_clone(view);
+	rec->eval = eval;
+	list_add_tail(&rec->_l, &t->records);
+
+	if (improve && !deterministic) {
+		pthread_mutex_lock(&t->parallel->m);
+		t->parallel->incumbent = fmin(t->parallel->incumbent, eval);
+		pthread_mutex_unlock(&t->parallel->m);
+	}
 }
 
 static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t **new_view, double *new_eval) {
@@ -189,6 +321,10 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 		return true;
 	}
 
+	if (a->task && task_is_obsolete(a->task)) {
+		return true;
+	}
+
 	// IMPROVEMENT: stop when at maximum number of acquired resources necessary for optimal utility
 	// PROBLEM: if optimal utility can't be reached, next best utility might require more resources
 	if (pos == a->agent->dcop->hardware->number_of_resources || (a->max_resources >= 0 && view_count_resources(a->new_view, a->agent->id) >= a->max_resources)) {
@@ -210,6 +346,10 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 
 			a->improve += improve;
 
+			if (a->task) {
+				record_assignment(a->task, a->new_view, *new_eval, true);
+			}
+
 			if (a->best_eval >= 0 && new_eval != &a->best_eval && *new_eval == a->best_eval) {
 				DEBUG_MESSAGE(a, "found assignment with optimal utility\n");
 				return true;
@@ -221,6 +361,10 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 			}
 		} else if (improve == 0 && (a->best_eval < 0 || new_eval == &a->best_eval) && view_count_resources(*new_view, a->agent->id) < view_count_resources(a->new_view, a->agent->id)) {
 			view_copy(*new_view, a->new_view);
+
+			if (a->task) {
+				record_assignment(a->task, a->new_view, *new_eval, false);
+			}
 		}
 		return false;
 	} else {
@@ -240,6 +384,12 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 			}
 		}*/
 
+		// IMPROVEMENT: skip subtrees that can't beat the best assignment found so far
+		if (search == MGM_SEARCH_BNB && can_prune(a, r, new_eval)) {
+			a->pruned++;
+			return false;
+		}
+
 		resource_t *next = list_entry(r->_l.next, resource_t, _l);
 		pos++;
 
@@ -254,6 +404,9 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 			agent_yield_resource(r);
 			result |= permutate_assignment(a, next, pos, new_view, new_eval);
 
+			// restore the resource, so every subtree is enumerated in the same order
+			agent_claim_resource(a->agent, r);
+
 			return result;
 		} else {
 			bool result = false;
@@ -277,15 +430,171 @@ static bool permutate_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t
 	}
 }
 
+// claims or yields r relative to its initial state (status, owner)
+static void gray_flip(mgm_agent_t *a, resource_t *r, bool flipped, int status, int owner) {
+	if (!flipped) {
+		r->status = status;
+		r->owner = owner;
+	} else if (status == RESOURCE_STATUS_TAKEN && owner == a->agent->id) {
+		agent_yield_resource(r);
+	} else {
+		agent_claim_resource(a->agent, r);
+	}
+}
+
+/*
+ * Iterative counterpart to permutate_assignment: walks all assignments of the
+ * partition in Gray-code order, so consecutive candidates differ in a single
+ * resource and can be rated through the constraints' delta evaluation.
+ */
+static bool gray_assignment(mgm_agent_t *a, resource_t *r, int pos, view_t **new_view, double *new_eval) {
+	int k = a->new_view->size;
+
+	if (!agent_supports_delta(a->agent) || k > MGM_GRAY_MAX_RESOURCES || r != list_first_entry(&a->new_view->resources, resource_t, _l)) {
+		return permutate_assignment(a, r, pos, new_view, new_eval);
+	}
+
+	// IMPROVEMENT: stop when optimal utility is acquired
+	if (a->best_eval >= 0 && new_eval != &a->best_eval && *new_eval == a->best_eval) {
+		return true;
+	}
+
+	view_t *view = a->new_view;
+	if (a->new_view->size != a->agent->view->size) {
+		view = view_clone(a->agent->view);
+		view_update(view, a->new_view);
+	}
+
+	resource_t *partition[k];
+	resource_t *resources[k];
+	int status[k];
+	int owner[k];
+
+	int i = 0;
+	for_each_entry(resource_t, _r, &a->new_view->resources) {
+		partition[i] = _r;
+		resources[i] = view == a->new_view ? _r : view_get_resource(view, _r->index);
+		status[i] = _r->status;
+		owner[i] = _r->owner;
+		i++;
+	}
+
+	int count = view_count_resources(a->new_view, a->agent->id);
+	int best_count = view_count_resources(*new_view, a->agent->id);
+
+	view_t *_view = a->agent->view;
+
+	double eval = agent_delta_reset_view(a->agent, view);
+
+	unsigned long code = 0;
+	unsigned long best_code = 0;
+	bool found = false;
+
+	bool result = false;
+
+	for (unsigned long g = 0; g < (1UL << k); g++) {
+		if (g > 0) {
+			i = __builtin_ctzl(g);
+			code ^= 1UL << i;
+
+			gray_flip(a, resources[i], code & (1UL << i), status[i], owner[i]);
+			count += agent_is_owner(a->agent, resources[i]) ? 1 : -1;
+
+			eval = agent_delta_update(a->agent, resources[i]);
+		}
+
+#ifdef DEBUG_NATIVE_CONSTRAINTS
+		double _eval = agent_evaluate(a->agent);
+		if (_eval != eval) {
+			print_error("delta evaluation different from full evaluation: %f vs %f\n", eval, _eval);
+		}
+#endif
+
+		// IMPROVEMENT: skip assignments with more resources than necessary for optimal utility
+		if (a->max_resources >= 0 && count > a->max_resources) {
+			continue;
+		}
+
+		double improve = mgm_rate_improvement(a, eval, new_eval);
+		if (improve > 0) {
+			DEBUG_MESSAGE(a, "considering new assignment with improvement %f\n", improve);
+
+			best_code = code;
+			best_count = count;
+			found = true;
+
+			a->improve += improve;
+
+			if (a->best_eval >= 0 && new_eval != &a->best_eval && *new_eval == a->best_eval) {
+				DEBUG_MESSAGE(a, "found assignment with optimal utility\n");
+				result = true;
+				break;
+			}
+
+			if (*new_eval == 0 && a->best_eval >= 0) {
+				DEBUG_MESSAGE(a, "utility 0 is optimal\n");
+				result = true;
+				break;
+			}
+		} else if (improve == 0 && (a->best_eval < 0 || new_eval == &a->best_eval) && best_count < count) {
+			best_code = code;
+			best_count = count;
+			found = true;
+		}
+	}
+
+	a->agent->view = _view;
+
+	for (i = 0; i < k; i++) {
+		resources[i]->status = status[i];
+		resources[i]->owner = owner[i];
+	}
+
+	if (view != a->new_view) {
+		view_free(view);
+	}
+
+	if (found) {
+		for (i = 0; i < k; i++) {
+			gray_flip(a, partition[i], best_code & (1UL << i), status[i], owner[i]);
+		}
+
+		view_copy(*new_view, a->new_view);
+
+		for (i = 0; i < k; i++) {
+			partition[i]->status = status[i];
+			partition[i]->owner = owner[i];
+		}
+	}
+
+	return result;
+}
+
+static bool search_assignment(mgm_agent_t *a, int pos, view_t **new_view, double *new_eval) {
+	resource_t *r = list_first_entry(&a->new_view->resources, resource_t, _l);
+
+	if (search == MGM_SEARCH_GRAY) {
+		return gray_assignment(a, r, pos, new_view, new_eval);
+	} else {
+		return permutate_assignment(a, r, pos, new_view, new_eval);
+	}
+}
+
 static struct list_head * split(mgm_agent_t *a, int max_tiles) {
 	struct list_head *regions = tlm_malloc(a->agent->tlm, sizeof(struct list_head));
 	INIT_LIST_HEAD(regions);
 
-	for (int i = 1; i <= a->agent->dcop->hardware->number_of_tiles; i += max_tiles) {
+	// groups neighbouring tiles on the NoC if the hardware has a topology
+	int *tiles = tlm_malloc(a->agent->tlm, a->agent->dcop->hardware->number_of_tiles * sizeof(int));
+	hardware_group_tiles(a->agent->dcop->hardware, max_tiles, tiles);
+
+	for (int i = 0; i < a->agent->dcop->hardware->number_of_tiles; i += max_tiles) {
 		view_t *subview = view_new_tlm(a->agent->tlm);
 
-		for (int j = 0; j < min(max_tiles, a->agent->dcop->hardware->number_of_tiles - i + 1); j++) {
-			resource_t *r = view_get_tile(a->new_view, i + j, NULL);
+		for (int j = 0; j < min(max_tiles, a->agent->dcop->hardware->number_of_tiles - i); j++) {
+			int tile = tiles[i + j];
+
+			resource_t *r = view_get_tile(a->new_view, tile, NULL);
 
 			if (!r) {
 				continue;
@@ -299,15 +608,197 @@ static struct list_head * split(mgm_agent_t *a, int max_tiles) {
 				} else {
 					r = list_entry(r->_l.next, resource_t, _l);
 				}
-			} while (r->tile == i + j);
+			} while (r->tile == tile);
 		}
 
 		list_add_tail(&subview->_l, regions);
 	}
 
+	tlm_free(a->agent->tlm, tiles);
+
 	return regions;
 }
 
+static void run_task(void *arg) {
+	mgm_task_t *t = (mgm_task_t *) arg;
+
+	if (permutate_assignment(&t->a, t->r, t->pos, &t->new_view, &t->new_eval)) {
+		pthread_mutex_lock(&t->parallel->m);
+		if (!deterministic) {
+			__atomic_store_n(&t->parallel->stop, -1, __ATOMIC_RELAXED);
+		} else if (t->index < t->parallel->stop) {
+			__atomic_store_n(&t->parallel->stop, t->index, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&t->parallel->m);
+	}
+}
+
+// enumerates the first depth resources of the subregion like permutate_assignment and submits a task per subtree
+static void add_tasks(mgm_agent_t *a, mgm_parallel_t *p, view_t *region, int index, resource_t *r, int pos, int offset, int depth) {
+	if (depth == 0 || pos == a->agent->dcop->hardware->number_of_resources || (a->max_resources >= 0 && view_count_resources(a->new_view, a->agent->id) >= a->max_resources)) {
+		mgm_task_t *t = (mgm_task_t *) tlm_malloc(a->agent->tlm, sizeof(mgm_task_t));
+
+		t->a = *a;
+		t->a.new_view = view_clone(a->new_view);
+		t->a.improve = 0;
+		t->a.pruned = 0;
+		t->a.task = t;
+
+		t->parallel = p;
+		t->index = p->number_of_tasks++;
+		t->region = index;
+
+		t->r = list_first_entry(&t->a.new_view->resources, resource_t, _l);
+		for (int i = 0; i < offset; i++) {
+			t->r = list_entry(t->r->_l.next, resource_t, _l);
+		}
+		t->pos = pos;
+
+		t->new_view = view_clone(region);
+		t->new_eval = a->eval;
+
+		INIT_LIST_HEAD(&t->records);
+
+		list_add_tail(&t->_l, &p->tasks);
+
+		pool_submit(pool, &p->group, run_task, t);
+
+		return;
+	}
+
+	resource_t *next = list_entry(r->_l.next, resource_t, _l);
+
+	if (agent_is_owner(a->agent, r)) {
+		add_tasks(a, p, region, index, next, pos + 1, offset + 1, depth - 1);
+
+		agent_yield_resource(r);
+		add_tasks(a, p, region, index, next, pos + 1, offset + 1, depth - 1);
+
+		agent_claim_resource(a->agent, r);
+	} else {
+		int status = r->status;
+		int owner = r->owner;
+
+		add_tasks(a, p, region, index, next, pos + 1, offset + 1, depth - 1);
+
+		agent_claim_resource(a->agent, r);
+		add_tasks(a, p, region, index, next, pos + 1, offset + 1, depth - 1);
+
+		r->status = status;
+		r->owner = owner;
+	}
+}
+
+// searches the subregions on the pool, returns once all tasks are done
+static mgm_parallel_t * search_subregions(mgm_agent_t *a, struct list_head *regions) {
+	mgm_parallel_t *p = (mgm_parallel_t *) tlm_malloc(a->agent->tlm, sizeof(mgm_parallel_t));
+
+	pool_group_init(&p->group);
+	INIT_LIST_HEAD(&p->tasks);
+	p->number_of_tasks = 0;
+	pthread_mutex_init(&p->m, NULL);
+	p->stop = INT_MAX;
+	p->incumbent = a->eval;
+
+	// about four tasks per worker and subregion
+	int depth = 0;
+	while ((1 << depth) < 4 * workers) {
+		depth++;
+	}
+
+	view_t *_view = a->new_view;
+
+	int index = 0;
+	for_each_entry(view_t, v, regions) {
+		view_t *region = view_clone(v);
+
+		a->new_view = v;
+
+		int pos = a->agent->dcop->hardware->number_of_resources - v->size;
+
+		add_tasks(a, p, region, index, list_first_entry(&v->resources, resource_t, _l), pos, 0, depth);
+
+		view_free(region);
+
+		// see try_subregions
+		if (a->best_eval < 0) {
+			break;
+		}
+
+		index++;
+	}
+
+	a->new_view = _view;
+
+	pool_wait(pool, &p->group);
+
+	return p;
+}
+
+// applies the assignments accepted by a task in the order the serial search would have found them
+static bool replay_task(mgm_agent_t *a, mgm_task_t *t, view_t **new_view, double *new_eval) {
+	for_each_entry(mgm_record_t, rec, &t->records) {
+		double improve = mgm_rate_improvement(a, rec->eval, new_eval);
+		if (improve > 0) {
+			view_copy(*new_view, rec->view);
+
+			a->improve += improve;
+
+			if (a->best_eval >= 0 && *new_eval == a->best_eval) {
+				DEBUG_MESSAGE(a, "found assignment with optimal utility\n");
+				return true;
+			}
+
+			if (*new_eval == 0 && a->best_eval >= 0) {
+				DEBUG_MESSAGE(a, "utility 0 is optimal\n");
+				return true;
+			}
+		} else if (improve == 0 && a->best_eval < 0 && view_count_resources(*new_view, a->agent->id) < view_count_resources(rec->view, a->agent->id)) {
+			view_copy(*new_view, rec->view);
+		}
+	}
+
+	return false;
+}
+
+static bool replay_subregion(mgm_agent_t *a, mgm_parallel_t *p, int index, view_t **new_view, double *new_eval) {
+	bool result = false;
+
+	for_each_entry(mgm_task_t, t, &p->tasks) {
+		if (t->region != index) {
+			continue;
+		}
+
+		a->pruned += t->a.pruned;
+
+		if (!result) {
+			result = replay_task(a, t, new_view, new_eval);
+		}
+	}
+
+	return result;
+}
+
+static void free_parallel(mgm_agent_t *a, mgm_parallel_t *p) {
+	for_each_entry_safe(mgm_task_t, t, _t, &p->tasks) {
+		for_each_entry_safe(mgm_record_t, rec, _rec, &t->records) {
+			list_del(&rec->_l);
+			view_free(rec->view);
+			tlm_free(a->agent->tlm, rec);
+		}
+
+		list_del(&t->_l);
+		view_free(t->a.new_view);
+		view_free(t->new_view);
+		tlm_free(a->agent->tlm, t);
+	}
+
+	pool_group_destroy(&p->group);
+	pthread_mutex_destroy(&p->m);
+
+	tlm_free(a->agent->tlm, p);
+}
+
 static void try_subregions(mgm_agent_t *a) {
 	a->improve = 0;
 
@@ -315,6 +806,12 @@ static void try_subregions(mgm_agent_t *a) {
 
 	struct list_head *regions = split(a, max_tiles);
 
+	// lua constraints and delta evaluation keep per agent state, so those are searched serially
+	mgm_parallel_t *parallel = NULL;
+	if (pool && !a->agent->has_lua_constraints && search != MGM_SEARCH_GRAY) {
+		parallel = search_subregions(a, regions);
+	}
+
 	view_t *_view = a->new_view;
 
 	double improve = 0;
@@ -322,6 +819,8 @@ static void try_subregions(mgm_agent_t *a) {
 
 	bool result = false;
 
+	int index = 0;
+
 	for_each_entry_safe(view_t, v, _v, regions) {
 		if (!result) {
 			DEBUG_MESSAGE(a, "check region\n");
@@ -335,7 +834,11 @@ static void try_subregions(mgm_agent_t *a) {
 
 			int pos = a->agent->dcop->hardware->number_of_resources - v->size;
 
-			result = permutate_assignment(a, list_first_entry(&a->new_view->resources, resource_t, _l), pos, &new_view, &new_eval);
+			if (parallel) {
+				result = replay_subregion(a, parallel, index, &new_view, &new_eval);
+			} else {
+				result = search_assignment(a, pos, &new_view, &new_eval);
+			}
 
 			if (a->improve > improve) {
 				improve = a->improve;
@@ -357,10 +860,16 @@ static void try_subregions(mgm_agent_t *a) {
 
 		list_del(&v->_l);
 		view_free(v);
+
+		index++;
 	}
 
 	a->new_view = _view;
 
+	if (parallel) {
+		free_parallel(a, parallel);
+	}
+
 	tlm_free(a->agent->tlm, regions);
 
 	if (view) {
@@ -430,7 +939,7 @@ static bool try_free_resources(mgm_agent_t *a) {
 	view_t *new_view = view_clone(a->new_view);
 	double new_eval = a->eval;
 
-	bool result = permutate_assignment(a, list_first_entry(&a->new_view->resources, resource_t, _l), pos, &new_view, &new_eval);
+	bool result = search_assignment(a, pos, &new_view, &new_eval);
 
 	a->new_view = _view;
 	if (result) {
@@ -449,7 +958,24 @@ static bool try_free_resources(mgm_agent_t *a) {
 	return result;
 }
 
-static void improve(mgm_agent_t *a) {
+// searches a better assignment for the current view into a->new_view, a->eval has to be up to date
+void mgm_find_assignment(mgm_agent_t *a) {
+	PROFILE_BEGIN(t);
+
+	a->improve = 0;
+
+	// IMPROVEMENT: try to acquire optimal utility by only looking at free resources
+	if (try_free_resources(a)) {
+		DEBUG_MESSAGE(a, "free resources satisfied constraints\n");
+	} else {
+		//find_assignment(a);
+		try_subregions(a);
+	}
+
+	PROFILE_END(a->agent->profile[PROFILE_SEARCH], t);
+}
+
+void mgm_improve(mgm_agent_t *a) {
 	a->eval = agent_evaluate(a->agent);
 
 	// IMPROVEMENT: don't try to improve if resource assignment hasn't changed
@@ -474,17 +1000,11 @@ static void improve(mgm_agent_t *a) {
 
 	DEBUG_MESSAGE(a, "tyring to improve... (utility: %f)\n", a->eval);
 
-	// IMPROVEMENT: try to acquire optimal utility by only looking at free resources
-	if (try_free_resources(a)) {
-		DEBUG_MESSAGE(a, "free resources satisfied constraints\n");
-	} else {
-		//find_assignment(a);
-		try_subregions(a);
-	}
+	mgm_find_assignment(a);
 }
 
 static void send_improve(mgm_agent_t *a) {
-	improve(a);
+	mgm_improve(a);
 
 	if (a->improve > 0) {
 		a->can_move = true;
@@ -563,13 +1083,210 @@ static void get_optimal_utility(mgm_agent_t *a) {
 	//view_free(best_view);
 }
 
-static void * mgm(void *arg) {
-	mgm_agent_t *a = (mgm_agent_t *) arg;
+// FNV-1a
+static uint64_t hash_bytes(uint64_t h, const void *p, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		h ^= ((const unsigned char *) p)[i];
+		h *= 1099511628211ULL;
+	}
 
-	tlm_touch(a->agent->tlm);
+	return h;
+}
+
+#define hash_string(h, s) hash_bytes(h, s, strlen(s) + 1)
+
+// neighbors only contribute their number, agents with the same constraints on different neighbors match
+static uint64_t hash_constraint(uint64_t h, constraint_t *c) {
+	h = hash_string(h, c->name);
+	h = hash_bytes(h, &c->param.number_of_neighbors, sizeof(int));
+
+	for (int i = 0; i < c->param.argc; i++) {
+		argument_t *arg = &c->param.args[i];
+
+		h = hash_bytes(h, &arg->type, sizeof(arg->type));
+
+		switch (arg->type) {
+			case OBJECT_TYPE_NUMBER:
+				h = hash_bytes(h, &arg->number, sizeof(double));
+				break;
+
+			case OBJECT_TYPE_CONSTRAINT:
+				h = hash_constraint(h, arg->constraint);
+				break;
+
+			case OBJECT_TYPE_STRING:
+				h = hash_string(h, arg->string);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return h;
+}
+
+static uint64_t get_signature(mgm_agent_t *a) {
+	uint64_t h = 14695981039346656037ULL;
+
+	h = hash_bytes(h, &max_tiles, sizeof(int));
+
+	// partitions follow the NoC topology
+	hardware_t *hw = a->agent->dcop->hardware;
+	if (hw->hops) {
+		h = hash_bytes(h, hw->hops, (hw->number_of_tiles + 1) * (hw->number_of_tiles + 1) * sizeof(int));
+	}
+
+	for_each_entry(resource_t, r, &a->agent->view->resources) {
+		h = hash_string(h, r->type);
+		h = hash_bytes(h, &r->tile, sizeof(int));
+	}
+
+	for_each_entry(constraint_t, c, &a->agent->constraints) {
+		h = hash_constraint(h, c);
+	}
+
+	return h;
+}
+
+static bool has_unknown_argument(constraint_t *c) {
+	for (int i = 0; i < c->param.argc; i++) {
+		argument_t *arg = &c->param.args[i];
+
+		if (arg->type == OBJECT_TYPE_UNKNOWN || (arg->type == OBJECT_TYPE_CONSTRAINT && has_unknown_argument(arg->constraint))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// lua constraints and arguments not covered by the signature may differ between agents with the same signature
+static bool is_cacheable(mgm_agent_t *a) {
+	if (a->agent->has_lua_constraints || !a->agent->has_native_constraints) {
+		return false;
+	}
+
+	for_each_entry(constraint_t, c, &a->agent->constraints) {
+		if (has_unknown_argument(c)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static mgm_cache_entry_t * cache_lookup(uint64_t signature) {
+	for_each_entry(mgm_cache_entry_t, e, &cache) {
+		if (e->signature == signature) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static mgm_cache_entry_t * cache_insert(uint64_t signature, bool ready, double best_eval, int max_resources) {
+	mgm_cache_entry_t *e = (mgm_cache_entry_t *) calloc(1, sizeof(mgm_cache_entry_t));
+
+	e->signature = signature;
+	e->ready = ready;
+	e->best_eval = best_eval;
+	e->max_resources = max_resources;
+
+	list_add_tail(&e->_l, &cache);
+
+	return e;
+}
+
+static void load_cache() {
+	FILE *f = fopen(cache_file, "r");
+	if (!f) {
+		return;
+	}
+
+	unsigned long long signature;
+	double best_eval;
+	int max_resources;
 
-	dcop_start_ROI(a->agent->dcop);
+	int n = 0;
+	while (fscanf(f, "%llx %lf %i", &signature, &best_eval, &max_resources) == 3) {
+		if (!cache_lookup(signature)) {
+			cache_insert(signature, true, best_eval, max_resources);
+			n++;
+		}
+	}
 
+	fclose(f);
+
+	print("mgm: loaded %i optimal utilities from '%s'\n", n, cache_file);
+}
+
+static void save_cache() {
+	FILE *f = fopen(cache_file, "w");
+	if (!f) {
+		print_error("mgm: failed to write cache to '%s'\n", cache_file);
+		return;
+	}
+
+	for_each_entry(mgm_cache_entry_t, e, &cache) {
+		if (e->ready) {
+			fprintf(f, "%llx %.17g %i\n", (unsigned long long) e->signature, e->best_eval, e->max_resources);
+		}
+	}
+
+	fclose(f);
+}
+
+// agents with the same signature wait for the first one to determine the optimal utility
+static void get_cached_optimal_utility(mgm_agent_t *a) {
+	if (!is_cacheable(a)) {
+		get_optimal_utility(a);
+
+		return;
+	}
+
+	uint64_t signature = get_signature(a);
+
+	pthread_mutex_lock(&cache_m);
+
+	mgm_cache_entry_t *e = cache_lookup(signature);
+	if (e) {
+		while (!e->ready) {
+			pthread_cond_wait(&cache_cv, &cache_m);
+		}
+
+		a->best_eval = e->best_eval;
+		a->max_resources = e->max_resources;
+
+		cache_hits++;
+
+		pthread_mutex_unlock(&cache_m);
+
+		DEBUG_MESSAGE(a, "optimal utility: %f with %i resources (cached)\n", a->best_eval, a->max_resources);
+
+		return;
+	}
+
+	e = cache_insert(signature, false, 0, -1);
+
+	pthread_mutex_unlock(&cache_m);
+
+	get_optimal_utility(a);
+
+	pthread_mutex_lock(&cache_m);
+
+	e->best_eval = a->best_eval;
+	e->max_resources = a->max_resources;
+	e->ready = true;
+
+	pthread_cond_broadcast(&cache_cv);
+
+	pthread_mutex_unlock(&cache_m);
+}
+
+// initializes the search state of an agent and determines its optimal utility
+void mgm_setup(mgm_agent_t *a) {
 	a->term = 0;
 	a->can_move = false;
 	a->eval = 0;
@@ -580,16 +1297,36 @@ static void * mgm(void *arg) {
 
 	a->stale = false;
 
-	a->changed = true;
+	// agents unaffected by arrivals or departures don't search until a neighbor moves
+	a->changed = a->agent->dirty;
+
+	a->pruned = 0;
+
+	a->rounds = 0;
+
+	a->task = NULL;
 
 	a->initial_eval = agent_evaluate(a->agent);
 
-	get_optimal_utility(a);
+	get_cached_optimal_utility(a);
+}
+
+static void * mgm(void *arg) {
+	mgm_agent_t *a = (mgm_agent_t *) arg;
+
+	tlm_touch(a->agent->tlm);
+
+	dcop_start_ROI(a->agent);
+
+	mgm_setup(a);
 
 	mgm_mode_t mode = MGM_WAIT_OK_MODE;
 
 	int counter = 0;
 
+	// with quiescence detection stale agents wait for a neighbor to start another round
+	bool passive = false;
+
 	bool stop = false;
 	while (!stop) {
 		//DEBUG_MESSAGE(a, "mgm: waiting for messages...\n");
@@ -607,6 +1344,15 @@ static void * mgm(void *arg) {
 
 		switch(mgm_message(msg)->type) {
 			case MGM_OK:
+				if (passive) {
+					passive = false;
+
+					if (send_ok(a)) {
+						stop = true;
+						break;
+					}
+				}
+
 				counter++;
 
 				view_copy(a->agent->agent_view[msg->from->id], mgm_message(msg)->view);
@@ -666,7 +1412,10 @@ static void * mgm(void *arg) {
 						a->stale = false;
 					}
 
-					if (send_ok(a)) {
+					if (quiescence && a->stale) {
+						passive = true;
+						termination_set_passive(a->agent);
+					} else if (send_ok(a)) {
 						stop = true;
 						break;
 					}
@@ -686,11 +1435,11 @@ static void * mgm(void *arg) {
 				break;
 
 			case MGM_START:
-				//dcop_start_ROI(a->agent->dcop);
+				//dcop_start_ROI(a->agent);
 
 				if (!agent_has_neighbors(a->agent)) {
 					// algorithm not really suited for that case, not sure what to do here...
-					improve(a);
+					mgm_improve(a);
 					if (a->improve > 0) {
 						view_copy(a->agent->view, a->new_view);
 					}
@@ -704,7 +1453,10 @@ static void * mgm(void *arg) {
 		message_free(msg);
 	}
 
-	dcop_stop_ROI(a->agent->dcop);
+	// agents stopping on their own must not hold back the detection
+	termination_set_passive(a->agent);
+
+	dcop_stop_ROI(a->agent);
 
 	// pthread_exit crashes sniper/valgrind with signal 4 illegal instruction?
 	//pthread_exit(agent);
@@ -720,24 +1472,44 @@ static void mgm_usage() {
 	printf("	--partition SIZE, -p SIZE\n");
 	printf("		parition size used\n");
 	printf("\n");
+	printf("	--search MODE, -s MODE\n");
+	printf("		search used for partitions: exhaustive (default), bnb, gray\n");
+	printf("\n");
+	printf("	--workers N, -w N\n");
+	printf("		search subregions in parallel on a shared pool of N worker threads\n");
+	printf("\n");
+	printf("	--deterministic, -D\n");
+	printf("		parallel search yields the same assignments as the serial search\n");
+	printf("\n");
+	printf("	--cache FILE, -c FILE\n");
+	printf("		load optimal utilities of agents from FILE and store them there\n");
+	printf("\n");
+	printf("	--quiescence, -q\n");
+	printf("		stop once no agent can improve anymore instead of on locally stale assignments\n");
+	printf("\n");
 }
 
 static int parse_arguments(int argc, char **argv) {
 	struct option long_options[] = {
 		{ "distance", required_argument, NULL, 'd' },
 		{ "partition", required_argument, NULL, 'p' },
+		{ "search", required_argument, NULL, 's' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ "deterministic", no_argument, NULL, 'D' },
+		{ "quiescence", no_argument, NULL, 'q' },
+		{ "cache", required_argument, NULL, 'c' },
 		{ 0 }
 	};
 
 	optind = 1;
 
 	while (true) {
-		int result = getopt_long(argc, argv, "d:p:", long_options, NULL);
+		int result = getopt_long(argc, argv, "d:p:s:w:Dqc:", long_options, NULL);
 		if (result == -1) {
 			break;
 		}
 
-		int distance, tiles;
+		int distance, tiles, n;
 
 		switch (result) {
 			case 'd':
@@ -762,6 +1534,50 @@ static int parse_arguments(int argc, char **argv) {
 				}
 				break;
 
+			case 's':
+				if (!strcmp(optarg, "exhaustive")) {
+					search = MGM_SEARCH_EXHAUSTIVE;
+				} else if (!strcmp(optarg, "bnb")) {
+					search = MGM_SEARCH_BNB;
+				} else if (!strcmp(optarg, "gray")) {
+					search = MGM_SEARCH_GRAY;
+				} else {
+					print_error("mgm: invalid search mode given\n");
+					print("mgm: using default search mode\n");
+					break;
+				}
+				print("mgm: search mode set to %s\n", optarg);
+				break;
+
+			case 'w':
+				n = (int) strtol(optarg, NULL, 10);
+				if (n < 0) {
+					print_error("mgm: invalid number of workers given\n");
+					print("mgm: searching subregions serially\n");
+				} else {
+					workers = n;
+					print("mgm: number of workers set to %i\n", workers);
+				}
+				break;
+
+			case 'D':
+				deterministic = true;
+				print("mgm: deterministic parallel search enabled\n");
+				break;
+
+			case 'q':
+				quiescence = true;
+				print("mgm: quiescence detection enabled\n");
+				break;
+
+			case 'c':
+				if (cache_file) {
+					free(cache_file);
+				}
+				cache_file = strdup(optarg);
+				print("mgm: caching optimal utilities in '%s'\n", cache_file);
+				break;
+
 			case '?':
 			case ':':
 			default:
@@ -773,9 +1589,25 @@ static int parse_arguments(int argc, char **argv) {
 	return 0;
 }
 
+static void mgm_kill(dcop_t *dcop);
+
 static void mgm_init(dcop_t *dcop, int argc, char **argv) {
 	parse_arguments(argc, argv);
 
+	if (workers > 0) {
+		pool = pool_create(workers);
+	}
+
+	if (quiescence) {
+		termination = termination_new(dcop, mgm_kill);
+	}
+
+	if (cache_file) {
+		load_cache();
+	}
+
+	cache_hits = 0;
+
 	for_each_entry(agent_t, a, &dcop->agents) {
 		//mgm_agent_t *_a = (mgm_agent_t *) calloc(1, sizeof(mgm_agent_t));
 		//mgm_agent_t *_a = (mgm_agent_t *) dcop_malloc_aligned(sizeof(mgm_agent_t));
@@ -797,6 +1629,9 @@ static void mgm_cleanup(dcop_t *dcop) {
 	double total_initial_eval = 0;
 	double total_optimal_eval = 0;
 	double total_eval = 0;
+	int rounds = 0;
+	unsigned long messages = 0;
+	size_t bytes = 0;
 
 	for_each_entry(agent_t, a, &dcop->agents) {
 		mgm_agent_t *_a = (mgm_agent_t *) agent_cleanup_thread(a);
@@ -808,6 +1643,11 @@ static void mgm_cleanup(dcop_t *dcop) {
 
 		DEBUG_MESSAGE(_a, "initial utility: %f\n", _a->initial_eval);
 		DEBUG_MESSAGE(_a, "current utility: %f\n", _a->eval);
+		DEBUG_MESSAGE(_a, "rounds: %i\n", _a->rounds);
+		DEBUG_MESSAGE(_a, "messages sent: %lu (%lu bytes)\n", _a->agent->messages_sent, _a->agent->bytes_sent);
+		if (search == MGM_SEARCH_BNB) {
+			DEBUG_MESSAGE(_a, "pruned subtrees: %lu\n", _a->pruned);
+		}
 
 		view_free(_a->new_view);
 
@@ -818,6 +1658,9 @@ static void mgm_cleanup(dcop_t *dcop) {
 		total_initial_eval += _a->initial_eval;
 		total_optimal_eval += _a->best_eval;
 		total_eval += _a->eval;
+		rounds = _a->rounds > rounds ? _a->rounds : rounds;
+		messages += _a->agent->messages_sent;
+		bytes += _a->agent->bytes_sent;
 
 		tlm_free(_a->agent->tlm, _a);
 
@@ -830,8 +1673,30 @@ static void mgm_cleanup(dcop_t *dcop) {
 	DEBUG print("total initial utility: %f\n", total_initial_eval);
 	DEBUG print("total optimal utility: %f\n", total_optimal_eval);
 	DEBUG print("total current utility: %f\n", total_eval);
+	DEBUG print("rounds: %i\n", rounds);
+	DEBUG print("total messages sent: %lu (%lu bytes)\n", messages, bytes);
 	DEBUG print("\n");
 
+	if (pool) {
+		pool_destroy(pool);
+		pool = NULL;
+	}
+
+	DEBUG print("cached optimal utilities used: %lu\n", cache_hits);
+	DEBUG print("\n");
+
+	if (cache_file) {
+		save_cache();
+	}
+
+	if (termination) {
+		DEBUG print("termination waves: %i\n", termination->waves);
+		DEBUG print("\n");
+
+		termination_free(termination);
+		termination = NULL;
+	}
+
 	if (!consistent) print_error("error: MGM algorithm finished in an incosistent state\n");
 }
 
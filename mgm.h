@@ -1,6 +1,37 @@
 #ifndef MGM_H_
 #define MGM_H_
 
+#include <stdbool.h>
+
+#include "agent.h"
+#include "view.h"
+
+typedef struct mgm_agent {
+	int term;
+	bool can_move;
+	double eval;
+	double improve;
+	view_t *new_view;
+	agent_t *agent;
+	bool consistent;
+	bool stale;
+	bool changed;
+	double initial_eval;
+	double best_eval;
+	int max_resources;
+	unsigned long pruned;
+	int rounds;
+	struct mgm_task *task;
+} mgm_agent_t;
+
+double mgm_rate_improvement(mgm_agent_t *a, double _eval, double *eval);
+
+void mgm_find_assignment(mgm_agent_t *a);
+
+void mgm_improve(mgm_agent_t *a);
+
+void mgm_setup(mgm_agent_t *a);
+
 void mgm_register();
 
 #endif /* MGM_H_ */
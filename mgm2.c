@@ -0,0 +1,721 @@
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agent.h"
+#include "algorithm.h"
+#include "console.h"
+#include "dcop.h"
+#include "list.h"
+#include "mgm.h"
+#include "mgm2.h"
+#include "resource.h"
+#include "view.h"
+
+/*
+ * MGM-2: in every round agents randomly act as offerers or receivers. An
+ * offerer proposes a joint move to one neighbor, i.e. the assignment it would
+ * choose if that neighbor yielded its resources. A receiver answers the best
+ * offer with its own best response, and the pair competes with its combined
+ * gain against the gains of all other neighbors of both partners.
+ */
+
+typedef struct mgm2_message {
+	enum {
+		MGM2_OK,
+		MGM2_OFFER,
+		MGM2_REPLY,
+		MGM2_GAIN,
+		MGM2_CONFIRM,
+		MGM2_END,
+		MGM2_START
+	} type;
+	view_t *view;
+	double eval;
+	double gain;
+	int term;
+	bool accept;
+} mgm2_message_t;
+
+typedef struct mgm2_agent {
+	mgm_agent_t mgm;
+	agent_t *agent;
+	struct random_data buf;
+	char statebuf[32];
+	agent_t *offered;
+	agent_t *partner;
+	view_t *joint_view;
+	double gain;
+	bool moved;
+	int offers;
+	int pairs;
+} mgm2_agent_t;
+
+static algorithm_t _mgm2;
+
+static int max_distance = 200;
+static double offer_probability = 0.5;
+
+#define mgm2_message(m) ((mgm2_message_t *) m->buf)
+
+#define DEBUG_MESSAGE(a, f, v...) do { console_lock(); print_debug("[%i]: ", a->agent->id); DEBUG print(f, ## v); console_unlock(); } while (0)
+
+static void mgm2_message_free(tlm_t *tlm, void *buf) {
+	mgm2_message_t *msg = (mgm2_message_t *) buf;
+
+	if (msg) {
+		if (msg->view) {
+			view_free(msg->view);
+		}
+
+		tlm_free(tlm, msg);
+	}
+}
+
+static message_t * mgm2_message_new(mgm2_agent_t *a, int type) {
+	tlm_t *tlm = a ? a->agent->tlm : NULL;
+
+	mgm2_message_t *msg = (mgm2_message_t *) tlm_malloc(tlm, sizeof(mgm2_message_t));
+	msg->type = type;
+
+	return message_new(tlm, msg, sizeof(mgm2_message_t), mgm2_message_free);
+}
+
+static double random_d(mgm2_agent_t *a) {
+	int32_t i;
+	random_r(&a->buf, &i);
+
+	return (double) i / RAND_MAX;
+}
+
+static bool filter_mgm2_message(message_t *msg, void *type) {
+	return mgm2_message(msg)->type == (long) type || mgm2_message(msg)->type == MGM2_END || mgm2_message(msg)->type == MGM2_START;
+}
+
+static void send_end(mgm2_agent_t *a, agent_t *except) {
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		if (n->agent != except) {
+			agent_send(a->agent, n->agent, mgm2_message_new(a, MGM2_END));
+		}
+	}
+}
+
+// receives the next message of a phase, NULL if the algorithm has been stopped
+static message_t * recv_phase(mgm2_agent_t *a, int type) {
+	message_t *msg = agent_recv_filter(a->agent, filter_mgm2_message, (void *) (long) type);
+
+	if (mgm2_message(msg)->type == MGM2_END) {
+		// unlike MGM the end is propagated, otherwise agents further away would wait forever
+		send_end(a, msg->from);
+
+		message_free(msg);
+
+		return NULL;
+	}
+
+	return msg;
+}
+
+// rates view with the agent view of neighbor n replaced
+static double evaluate(mgm2_agent_t *a, view_t *view, agent_t *n, view_t *agent_view) {
+	view_t *_agent_view = a->agent->agent_view[n->id];
+
+	a->agent->agent_view[n->id] = agent_view;
+
+	double eval = agent_evaluate_view(a->agent, view);
+
+	a->agent->agent_view[n->id] = _agent_view;
+
+	return eval;
+}
+
+// best assignment starting from view with the agent view of neighbor n replaced, NULL if view can't be improved
+static view_t * search(mgm2_agent_t *a, view_t *view, agent_t *n, view_t *agent_view) {
+	mgm_agent_t s = a->mgm;
+
+	view_t *_view = a->agent->view;
+	view_t *_agent_view = a->agent->agent_view[n->id];
+
+	a->agent->view = view;
+	a->agent->agent_view[n->id] = agent_view;
+
+	s.new_view = view_clone(view);
+	s.eval = agent_evaluate(a->agent);
+
+	mgm_find_assignment(&s);
+
+	a->agent->view = _view;
+	a->agent->agent_view[n->id] = _agent_view;
+
+	a->mgm.pruned = s.pruned;
+
+	if (s.improve > 0) {
+		return s.new_view;
+	}
+
+	view_free(s.new_view);
+
+	return NULL;
+}
+
+static void release_resources(view_t *v, int id) {
+	for_each_entry(resource_t, r, &v->resources) {
+		if (resource_get_owner(r) == id) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+}
+
+// the assignment the agent would choose if neighbor n yielded its resources
+static view_t * create_offer(mgm2_agent_t *a, agent_t *n, double *gain) {
+	view_t *view = view_clone(a->agent->view);
+	view_t *agent_view = view_clone(a->agent->agent_view[n->id]);
+
+	release_resources(view, n->id);
+	release_resources(agent_view, n->id);
+
+	view_t *offer = search(a, view, n, agent_view);
+
+	view_free(view);
+	view_free(agent_view);
+
+	if (!offer) {
+		return NULL;
+	}
+
+	// n only yields the resources claimed by the offer
+	agent_view = view_clone(a->agent->agent_view[n->id]);
+	for_each_entry(resource_t, r, &agent_view->resources) {
+		resource_t *_r = view_get_resource(offer, r->index);
+
+		if (_r && agent_is_owner(a->agent, _r)) {
+			agent_claim_resource(a->agent, r);
+		}
+	}
+
+	*gain = mgm_rate_improvement(&a->mgm, evaluate(a, offer, n, agent_view), NULL);
+
+	view_free(agent_view);
+
+	if (*gain == -INFINITY) {
+		view_free(offer);
+
+		return NULL;
+	}
+
+	return offer;
+}
+
+// best response to the offer of neighbor n, the result is the joint assignment
+static view_t * answer_offer(mgm2_agent_t *a, agent_t *n, view_t *offer, double *gain) {
+	view_t *view = view_clone(a->agent->view);
+
+	for_each_entry(resource_t, r, &view->resources) {
+		resource_t *_r = view_get_resource(offer, r->index);
+
+		if (!_r) {
+			continue;
+		}
+
+		if (resource_get_owner(_r) == n->id) {
+			r->status = RESOURCE_STATUS_TAKEN;
+			r->owner = n->id;
+		} else if (resource_get_owner(r) == n->id) {
+			r->status = RESOURCE_STATUS_FREE;
+		}
+	}
+
+	view_t *response = search(a, view, n, offer);
+	if (response) {
+		view_free(view);
+	} else {
+		response = view;
+	}
+
+	// the response must not claim resources claimed by the offer
+	for_each_entry(resource_t, r, &response->resources) {
+		resource_t *_r = view_get_resource(offer, r->index);
+
+		if (_r && agent_is_owner(a->agent, r) && resource_get_owner(_r) == n->id) {
+			view_free(response);
+
+			return NULL;
+		}
+	}
+
+	*gain = mgm_rate_improvement(&a->mgm, evaluate(a, response, n, offer), NULL);
+
+	return response;
+}
+
+static int send_ok(mgm2_agent_t *a) {
+	a->mgm.rounds++;
+
+	// IMPROVEMENT: stop algorithm if no agent has changed its resource assignment
+	if (++a->mgm.term == max_distance || a->mgm.stale) {
+		if (a->mgm.stale) {
+			DEBUG_MESSAGE(a, "stopping algorithm due to stale resource assignment\n");
+		}
+
+		send_end(a, NULL);
+
+		return -1;
+	}
+
+	if (a->moved) {
+		view_t *view = a->partner ? a->joint_view : a->mgm.new_view;
+
+		char *s = view_to_string(view);
+		DEBUG_MESSAGE(a, "updating to view (%f):\n%s", a->gain, s);
+		free(s);
+
+		view_copy(a->agent->view, view);
+	}
+
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		message_t *msg = mgm2_message_new(a, MGM2_OK);
+		mgm2_message(msg)->view = view_clone(a->agent->view);
+		agent_send(a->agent, n->agent, msg);
+	}
+
+	if (a->joint_view) {
+		view_free(a->joint_view);
+		a->joint_view = NULL;
+	}
+	a->partner = NULL;
+
+	return 0;
+}
+
+static bool recv_ok(mgm2_agent_t *a) {
+	for (int i = 0; i < a->agent->number_of_neighbors; i++) {
+		message_t *msg = recv_phase(a, MGM2_OK);
+		if (!msg) {
+			return false;
+		}
+
+		view_copy(a->agent->agent_view[msg->from->id], mgm2_message(msg)->view);
+
+		message_free(msg);
+	}
+
+	if (!a->moved) {
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			if (!view_compare(a->agent->view, a->agent->agent_view[n->agent->id])) {
+				if (view_is_affected(a->agent->view, a->agent->id, a->agent->agent_view[n->agent->id])) {
+					a->mgm.changed = true;
+				}
+
+				view_copy(a->agent->view, a->agent->agent_view[n->agent->id]);
+				break;
+			}
+		}
+	} else {
+		a->mgm.changed = true;
+	}
+
+	a->mgm.consistent = true;
+
+	a->mgm.stale = true;
+
+	return true;
+}
+
+static void send_offers(mgm2_agent_t *a) {
+	a->offered = NULL;
+
+	view_t *offer = NULL;
+	double gain = 0;
+
+	if (random_d(a) < offer_probability) {
+		int32_t i;
+		random_r(&a->buf, &i);
+		i %= a->agent->number_of_neighbors;
+
+		for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+			if (i-- == 0) {
+				a->offered = n->agent;
+				break;
+			}
+		}
+
+		a->mgm.eval = agent_evaluate(a->agent);
+
+		offer = create_offer(a, a->offered, &gain);
+		if (!offer) {
+			a->offered = NULL;
+		} else {
+			DEBUG_MESSAGE(a, "offering joint move to agent %i (gain %f)\n", a->offered->id, gain);
+
+			a->offers++;
+		}
+	}
+
+	// every neighbor receives an offer, possibly an empty one, to keep the rounds in lock-step
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		message_t *msg = mgm2_message_new(a, MGM2_OFFER);
+		if (n->agent == a->offered) {
+			mgm2_message(msg)->view = offer;
+			mgm2_message(msg)->gain = gain;
+		}
+		agent_send(a->agent, n->agent, msg);
+	}
+}
+
+static bool reply_offers(mgm2_agent_t *a) {
+	int number_of_offers = 0;
+	message_t *offers[a->agent->number_of_neighbors];
+
+	for (int i = 0; i < a->agent->number_of_neighbors; i++) {
+		message_t *msg = recv_phase(a, MGM2_OFFER);
+		if (!msg) {
+			for (int j = 0; j < number_of_offers; j++) {
+				message_free(offers[j]);
+			}
+
+			return false;
+		}
+
+		if (mgm2_message(msg)->view) {
+			offers[number_of_offers++] = msg;
+		} else {
+			message_free(msg);
+		}
+	}
+
+	mgm_improve(&a->mgm);
+
+	// offerers reject all offers they receive
+	message_t *best = NULL;
+	view_t *best_view = NULL;
+	double best_gain = 0;
+
+	for (int i = 0; i < number_of_offers && !a->offered; i++) {
+		double gain;
+		view_t *response = answer_offer(a, offers[i]->from, mgm2_message(offers[i])->view, &gain);
+
+		if (!response) {
+			continue;
+		}
+
+		gain += mgm2_message(offers[i])->gain;
+
+		if (gain > 0 && gain > a->mgm.improve && (!best || gain > best_gain || (gain == best_gain && offers[i]->from->id < best->from->id))) {
+			if (best_view) {
+				view_free(best_view);
+			}
+
+			best = offers[i];
+			best_view = response;
+			best_gain = gain;
+		} else {
+			view_free(response);
+		}
+	}
+
+	for (int i = 0; i < number_of_offers; i++) {
+		message_t *msg = mgm2_message_new(a, MGM2_REPLY);
+
+		if (offers[i] == best) {
+			DEBUG_MESSAGE(a, "accepting joint move with agent %i (gain %f)\n", best->from->id, best_gain);
+
+			mgm2_message(msg)->accept = true;
+			mgm2_message(msg)->gain = best_gain;
+			mgm2_message(msg)->view = view_clone(best_view);
+
+			a->partner = best->from;
+			a->joint_view = best_view;
+			a->gain = best_gain;
+		} else {
+			mgm2_message(msg)->accept = false;
+		}
+
+		agent_send(a->agent, offers[i]->from, msg);
+
+		message_free(offers[i]);
+	}
+
+	if (a->offered) {
+		message_t *msg = recv_phase(a, MGM2_REPLY);
+		if (!msg) {
+			return false;
+		}
+
+		if (mgm2_message(msg)->accept) {
+			a->partner = msg->from;
+			a->joint_view = mgm2_message(msg)->view;
+			a->gain = mgm2_message(msg)->gain;
+
+			mgm2_message(msg)->view = NULL;
+		}
+
+		message_free(msg);
+	}
+
+	return true;
+}
+
+static bool exchange_gains(mgm2_agent_t *a) {
+	if (!a->partner) {
+		a->gain = a->mgm.improve;
+	}
+
+	for_each_entry(neighbor_t, n, &a->agent->neighbors) {
+		message_t *msg = mgm2_message_new(a, MGM2_GAIN);
+		mgm2_message(msg)->eval = a->mgm.eval;
+		mgm2_message(msg)->gain = a->gain;
+		mgm2_message(msg)->term = a->mgm.term;
+		agent_send(a->agent, n->agent, msg);
+	}
+
+	bool go = a->gain > 0;
+
+	for (int i = 0; i < a->agent->number_of_neighbors; i++) {
+		message_t *msg = recv_phase(a, MGM2_GAIN);
+		if (!msg) {
+			return false;
+		}
+
+		a->mgm.term = a->mgm.term < mgm2_message(msg)->term ? a->mgm.term : mgm2_message(msg)->term;
+
+		// the partner reports the same joint gain
+		if (msg->from != a->partner && (mgm2_message(msg)->gain > a->gain || (mgm2_message(msg)->gain == a->gain && a->agent->id > msg->from->id))) {
+			go = false;
+		}
+
+		if (mgm2_message(msg)->eval == INFINITY) {
+			DEBUG_MESSAGE(a, "agent %i reported eval %f\n", msg->from->id, mgm2_message(msg)->eval);
+			a->mgm.consistent = false;
+		}
+
+		if (mgm2_message(msg)->gain > 0) {
+			a->mgm.stale = false;
+		}
+
+		message_free(msg);
+	}
+
+	if (a->gain > 0) {
+		a->mgm.stale = false;
+	}
+
+	if (a->partner) {
+		message_t *msg = mgm2_message_new(a, MGM2_CONFIRM);
+		mgm2_message(msg)->accept = go;
+		agent_send(a->agent, a->partner, msg);
+
+		msg = recv_phase(a, MGM2_CONFIRM);
+		if (!msg) {
+			return false;
+		}
+
+		go = go && mgm2_message(msg)->accept;
+
+		message_free(msg);
+
+		if (go) {
+			DEBUG_MESSAGE(a, "committing joint move with agent %i\n", a->partner->id);
+
+			a->pairs++;
+		}
+	}
+
+	a->moved = go;
+
+	// mgm_improve must skip the round after a move
+	a->mgm.can_move = go;
+
+	a->mgm.changed = false;
+
+	return true;
+}
+
+static void * mgm2(void *arg) {
+	mgm2_agent_t *a = (mgm2_agent_t *) arg;
+
+	tlm_touch(a->agent->tlm);
+
+	dcop_start_ROI(a->agent);
+
+	mgm_setup(&a->mgm);
+
+	message_t *msg = recv_phase(a, MGM2_START);
+
+	if (msg) {
+		message_free(msg);
+
+		if (!agent_has_neighbors(a->agent)) {
+			mgm_improve(&a->mgm);
+			if (a->mgm.improve > 0) {
+				view_copy(a->agent->view, a->mgm.new_view);
+			}
+		} else {
+			while (!send_ok(a) && recv_ok(a)) {
+				send_offers(a);
+
+				if (!reply_offers(a) || !exchange_gains(a)) {
+					break;
+				}
+
+				agent_clear_agent_view(a->agent);
+			}
+		}
+	}
+
+	a->mgm.eval = agent_evaluate(a->agent);
+
+	dcop_stop_ROI(a->agent);
+
+	return (void *) a;
+}
+
+static void mgm2_usage() {
+	printf("\n");
+	printf("OPTIONS:\n");
+	printf("	--distance MAX, -d MAX\n");
+	printf("		maximum distance used by agents\n");
+	printf("\n");
+	printf("	--offer PROBABILITY, -o PROBABILITY\n");
+	printf("		probability of an agent to act as offerer in a round\n");
+	printf("\n");
+}
+
+static int parse_arguments(int argc, char **argv) {
+	struct option long_options[] = {
+		{ "distance", required_argument, NULL, 'd' },
+		{ "offer", required_argument, NULL, 'o' },
+		{ 0 }
+	};
+
+	optind = 1;
+
+	while (true) {
+		int result = getopt_long(argc, argv, "d:o:", long_options, NULL);
+		if (result == -1) {
+			break;
+		}
+
+		int distance;
+		double probability;
+
+		switch (result) {
+			case 'd':
+				distance = (int) strtol(optarg, NULL, 10);
+				if (distance <= 0) {
+					print_error("mgm2: invalid distance given\n");
+					print("mgm2: using default distance %i\n", max_distance);
+				} else {
+					max_distance = distance;
+					print("mgm2: distance set to %i\n", max_distance);
+				}
+				break;
+
+			case 'o':
+				probability = strtod(optarg, NULL);
+				if (probability < 0 || probability > 1) {
+					print_error("mgm2: invalid offer probability given\n");
+					print("mgm2: using default offer probability %f\n", offer_probability);
+				} else {
+					offer_probability = probability;
+					print("mgm2: offer probability set to %f\n", offer_probability);
+				}
+				break;
+
+			case '?':
+			case ':':
+			default:
+				print_error("mgm2: failed to parse algorithm paramters\n");
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void mgm2_init(dcop_t *dcop, int argc, char **argv) {
+	parse_arguments(argc, argv);
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		mgm2_agent_t *_a = (mgm2_agent_t *) tlm_malloc(a->tlm, sizeof(mgm2_agent_t));
+
+		_a->agent = a;
+		_a->mgm.agent = a;
+
+		unsigned int seed = dcop_get_seed() + a->id;
+		initstate_r(seed, _a->statebuf, sizeof(_a->statebuf), &_a->buf);
+		srandom_r(seed, &_a->buf);
+
+		agent_create_thread(a, mgm2, _a);
+	}
+	DEBUG print("\n");
+}
+
+static void mgm2_cleanup(dcop_t *dcop) {
+	double total_initial_eval = 0;
+	double total_eval = 0;
+	int rounds = 0;
+	unsigned long messages = 0;
+	size_t bytes = 0;
+	int pairs = 0;
+	bool consistent = true;
+
+	for_each_entry(agent_t, a, &dcop->agents) {
+		mgm2_agent_t *_a = (mgm2_agent_t *) agent_cleanup_thread(a);
+
+		DEBUG_MESSAGE(_a, "initial utility: %f\n", _a->mgm.initial_eval);
+		DEBUG_MESSAGE(_a, "current utility: %f\n", _a->mgm.eval);
+		DEBUG_MESSAGE(_a, "rounds: %i\n", _a->mgm.rounds);
+		DEBUG_MESSAGE(_a, "messages sent: %lu (%lu bytes)\n", a->messages_sent, a->bytes_sent);
+		DEBUG_MESSAGE(_a, "offers: %i, joint moves: %i\n", _a->offers, _a->pairs);
+
+		if (!_a->mgm.consistent) {
+			consistent = false;
+		}
+
+		total_initial_eval += _a->mgm.initial_eval;
+		total_eval += _a->mgm.eval;
+		rounds = _a->mgm.rounds > rounds ? _a->mgm.rounds : rounds;
+		messages += a->messages_sent;
+		bytes += a->bytes_sent;
+		pairs += _a->pairs;
+
+		view_free(_a->mgm.new_view);
+		if (_a->joint_view) {
+			view_free(_a->joint_view);
+		}
+
+		tlm_free(a->tlm, _a);
+	}
+	DEBUG print("\n");
+
+	DEBUG print("total initial utility: %f\n", total_initial_eval);
+	DEBUG print("total current utility: %f\n", total_eval);
+	DEBUG print("rounds: %i\n", rounds);
+	DEBUG print("total messages sent: %lu (%lu bytes)\n", messages, bytes);
+	// both partners count a joint move
+	DEBUG print("joint moves: %i\n", pairs / 2);
+	DEBUG print("\n");
+
+	if (!consistent) print_error("error: MGM-2 algorithm finished in an incosistent state\n");
+}
+
+static void mgm2_run(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, mgm2_message_new(NULL, MGM2_START));
+	}
+}
+
+static void mgm2_kill(dcop_t *dcop) {
+	for_each_entry(agent_t, a, &dcop->agents) {
+		agent_send(NULL, a, mgm2_message_new(NULL, MGM2_END));
+	}
+}
+
+void mgm2_register() {
+	_mgm2 = algorithm_new("mgm2", mgm2_init, mgm2_cleanup, mgm2_run, mgm2_kill, mgm2_usage);
+	dcop_register_algorithm(&_mgm2);
+}
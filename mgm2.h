@@ -0,0 +1,6 @@
+#ifndef MGM2_H_
+#define MGM2_H_
+
+void mgm2_register();
+
+#endif /* MGM2_H_ */
@@ -13,7 +13,7 @@ double tile(constraint_t *c) {
 	agent_t *a = c->param.agent;
 
 	for (int i = 1; i <= a->dcop->hardware->number_of_tiles; i++) {
-		resource_t *r = view_get_tile(a->view, i, NULL);
+		resource_t *r = view_get_tile(agent_get_view(a), i, NULL);
 
 		if (!r) {
 			continue;
@@ -32,7 +32,7 @@ double tile(constraint_t *c) {
 				return INFINITY;
 			}
 
-			if (r->_l.next == &a->view->resources) {
+			if (r->_l.next == &agent_get_view(a)->resources) {
 				break;
 			} else {
 				r = list_entry(r->_l.next, resource_t, _l);
@@ -50,7 +50,7 @@ double nec_re(constraint_t *c) {
 	m = c->param.args[1].number;
 
 	int i = 0;
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		if (agent_is_owner(a, r)) {
 			i++;
 		}
@@ -78,7 +78,7 @@ double type(constraint_t *c) {
 	m = c->param.args[2].number;
 
 	int i = 0;
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		if (agent_is_owner(a, r) && !strcmp(r->type, t)) {
 			i++;
 		}
@@ -98,11 +98,70 @@ double type(constraint_t *c) {
 	}
 }
 
+/*
+ * Bounds are evaluated on partial assignments: resources whose status is
+ * RESOURCE_STATUS_UNKNOWN are still undecided and may end up claimed or yielded.
+ * A bound must never exceed the rating of any completion of the assignment.
+ */
+
+static double constraint_bound(constraint_t *c) {
+	return c->bound ? c->bound(c) : -INFINITY;
+}
+
+static double count_bound(int i, int u, int n, int m) {
+	if (i > m || i + u < n) {
+		return INFINITY;
+	} else {
+		return 0;
+	}
+}
+
+double nec_re_bound(constraint_t *c) {
+	agent_t *a = c->param.agent;
+	int n, m;
+	n = c->param.args[0].number;
+	m = c->param.args[1].number;
+
+	int i = 0, u = 0;
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
+		if (agent_is_owner(a, r)) {
+			i++;
+		} else if (r->status == RESOURCE_STATUS_UNKNOWN) {
+			u++;
+		}
+	}
+
+	return count_bound(i, u, n, m);
+}
+
+double type_bound(constraint_t *c) {
+	agent_t *a = c->param.agent;
+	char *t = c->param.args[0].string;
+	int n, m;
+	n = c->param.args[1].number;
+	m = c->param.args[2].number;
+
+	int i = 0, u = 0;
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
+		if (strcmp(r->type, t)) {
+			continue;
+		}
+
+		if (agent_is_owner(a, r)) {
+			i++;
+		} else if (r->status == RESOURCE_STATUS_UNKNOWN) {
+			u++;
+		}
+	}
+
+	return count_bound(i, u, n, m);
+}
+
 double share(constraint_t *c) {
 	agent_t *a = c->param.agent;
 	int b = c->param.neighbors[0];
 
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		resource_t *_r = view_get_resource(a->agent_view[b], r->index);
 
 		if (_r && agent_is_owner(a, r) && resource_get_owner(_r) == b) {
@@ -119,7 +178,7 @@ double prefer_free(constraint_t *c) {
 
 	double n = 0;
 
-	for_each_entry(resource_t, r, &a->view->resources) {
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
 		resource_t *_r = view_get_resource(a->agent_view[b], r->index);
 
 		if (_r && agent_is_owner(a, r) && resource_get_owner(_r) == b) {
@@ -157,23 +216,20 @@ double _downey(double A, double sigma, double n) {
 	return S;
 }
 
-double downey(constraint_t *c) {
-	agent_t *a = c->param.agent;
-	int b = c->param.neighbors[0];
+static double downey_rating(constraint_t *c, int owned, int conflicts, int foreign_owned) {
 	double a_A = c->param.args[0].number;
 	double a_sigma = c->param.args[1].number;
 	double b_A = c->param.args[2].number;
 	double b_sigma = c->param.args[3].number;
 
-	int conflicts;
-	if ((conflicts = agent_has_conflicting_view(a, b)) == 0) {
+	if (conflicts == 0) {
 		return 0;
 	}
 
 	//double d_A = _downey(a_A, a_sigma, view_count_resources(a->view, a->id));
 	//double d_B = _downey(b_A, b_sigma, view_count_resources(a->agent_view[b], b));
-	double s_A = _downey(a_A, a_sigma, view_count_resources(a->view, a->id)) - _downey(a_A, a_sigma, view_count_resources(a->view, a->id) - conflicts);
-	double s_B = fabs(_downey(b_A, b_sigma, view_count_resources(a->agent_view[b], b) - conflicts) - _downey(b_A, b_sigma, view_count_resources(a->agent_view[b], b)));
+	double s_A = _downey(a_A, a_sigma, owned) - _downey(a_A, a_sigma, owned - conflicts);
+	double s_B = fabs(_downey(b_A, b_sigma, foreign_owned - conflicts) - _downey(b_A, b_sigma, foreign_owned));
 
 	if (s_A > s_B) {
 		return 0;
@@ -182,12 +238,24 @@ double downey(constraint_t *c) {
 	}
 }
 
+double downey(constraint_t *c) {
+	agent_t *a = c->param.agent;
+	int b = c->param.neighbors[0];
+
+	int conflicts;
+	if ((conflicts = agent_has_conflicting_view(a, b)) == 0) {
+		return 0;
+	}
+
+	return downey_rating(c, view_count_resources(agent_get_view(a), a->id), conflicts, view_count_resources(a->agent_view[b], b));
+}
+
 double speedup(constraint_t *c) {
 	agent_t *a = c->param.agent;
 	double A = c->param.args[0].number;
 	double sigma = c->param.args[1].number;
 
-	double S = _downey(A, sigma, view_count_resources(a->view, a->id));
+	double S = _downey(A, sigma, view_count_resources(agent_get_view(a), a->id));
 
 	if (S != 0) {
 		return 1 / S;
@@ -196,6 +264,30 @@ double speedup(constraint_t *c) {
 	}
 }
 
+double speedup_bound(constraint_t *c) {
+	agent_t *a = c->param.agent;
+	double A = c->param.args[0].number;
+	double sigma = c->param.args[1].number;
+
+	int i = 0, u = 0;
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
+		if (agent_is_owner(a, r)) {
+			i++;
+		} else if (r->status == RESOURCE_STATUS_UNKNOWN) {
+			u++;
+		}
+	}
+
+	double bound = INFINITY;
+	for (int n = i; n <= i + u; n++) {
+		double S = _downey(A, sigma, n);
+
+		bound = fmin(bound, S != 0 ? 1 / S : 1);
+	}
+
+	return bound;
+}
+
 double and(constraint_t *c) {
 	constraint_t *c1 = c->param.args[0].constraint;
 	constraint_t *c2 = c->param.args[1].constraint;
@@ -210,10 +302,206 @@ double or(constraint_t *c) {
 	return fmin(c1->eval(c1), c2->eval(c2));
 }
 
+double and_bound(constraint_t *c) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmax(constraint_bound(c1), constraint_bound(c2));
+}
+
+double or_bound(constraint_t *c) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmin(constraint_bound(c1), constraint_bound(c2));
+}
+
 double nop(constraint_t *c) {
 	return 0;
 }
 
+/*
+ * Delta evaluation: reset rates the current view and caches the counts the
+ * rating depends on, update adjusts them after a single resource of the view
+ * has been claimed or yielded and returns the new rating.
+ */
+
+#define delta_sign(a, r) (agent_is_owner(a, r) ? 1 : -1)
+
+static int count_owned(agent_t *a, const char *t) {
+	int i = 0;
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
+		if (agent_is_owner(a, r) && (!t || !strcmp(r->type, t))) {
+			i++;
+		}
+	}
+
+	return i;
+}
+
+static double count_rating(int i, int n, int m) {
+	if (i >= n && i <= m) {
+		return 0;
+	} else {
+		return INFINITY;
+	}
+}
+
+static double speedup_rating(constraint_t *c, int n) {
+	double S = _downey(c->param.args[0].number, c->param.args[1].number, n);
+
+	if (S != 0) {
+		return 1 / S;
+	} else {
+		return 1;
+	}
+}
+
+static void reset_foreign(constraint_t *c) {
+	agent_t *a = c->param.agent;
+	int b = c->param.neighbors[0];
+
+	if (!c->delta.foreign) {
+		c->delta.foreign = tlm_malloc(c->tlm, a->dcop->hardware->number_of_resources * sizeof(bool));
+	} else {
+		memset(c->delta.foreign, 0, a->dcop->hardware->number_of_resources * sizeof(bool));
+	}
+
+	c->delta.foreign_owned = 0;
+	for_each_entry(resource_t, r, &a->agent_view[b]->resources) {
+		c->delta.foreign[r->index] = (resource_get_owner(r) == b);
+		if (c->delta.foreign[r->index]) {
+			c->delta.foreign_owned++;
+		}
+	}
+
+	c->delta.owned = 0;
+	c->delta.conflicts = 0;
+	for_each_entry(resource_t, r, &agent_get_view(a)->resources) {
+		if (agent_is_owner(a, r)) {
+			c->delta.owned++;
+			if (c->delta.foreign[r->index]) {
+				c->delta.conflicts++;
+			}
+		}
+	}
+}
+
+static void update_foreign(constraint_t *c, resource_t *r) {
+	int d = delta_sign(c->param.agent, r);
+
+	c->delta.owned += d;
+	if (c->delta.foreign[r->index]) {
+		c->delta.conflicts += d;
+	}
+}
+
+static double nop_update(constraint_t *c, resource_t *r) {
+	return 0;
+}
+
+static double nec_re_reset(constraint_t *c) {
+	c->delta.owned = count_owned(c->param.agent, NULL);
+
+	return count_rating(c->delta.owned, c->param.args[0].number, c->param.args[1].number);
+}
+
+static double nec_re_update(constraint_t *c, resource_t *r) {
+	c->delta.owned += delta_sign(c->param.agent, r);
+
+	return count_rating(c->delta.owned, c->param.args[0].number, c->param.args[1].number);
+}
+
+static double type_reset(constraint_t *c) {
+	c->delta.owned = count_owned(c->param.agent, c->param.args[0].string);
+
+	return count_rating(c->delta.owned, c->param.args[1].number, c->param.args[2].number);
+}
+
+static double type_update(constraint_t *c, resource_t *r) {
+	if (!strcmp(r->type, c->param.args[0].string)) {
+		c->delta.owned += delta_sign(c->param.agent, r);
+	}
+
+	return count_rating(c->delta.owned, c->param.args[1].number, c->param.args[2].number);
+}
+
+static double share_reset(constraint_t *c) {
+	reset_foreign(c);
+
+	return c->delta.conflicts > 0 ? INFINITY : 0;
+}
+
+static double share_update(constraint_t *c, resource_t *r) {
+	update_foreign(c, r);
+
+	return c->delta.conflicts > 0 ? INFINITY : 0;
+}
+
+static double prefer_free_reset(constraint_t *c) {
+	reset_foreign(c);
+
+	return (double) c->delta.conflicts / 2;
+}
+
+static double prefer_free_update(constraint_t *c, resource_t *r) {
+	update_foreign(c, r);
+
+	return (double) c->delta.conflicts / 2;
+}
+
+static double downey_reset(constraint_t *c) {
+	reset_foreign(c);
+
+	return downey_rating(c, c->delta.owned, c->delta.conflicts, c->delta.foreign_owned);
+}
+
+static double downey_update(constraint_t *c, resource_t *r) {
+	update_foreign(c, r);
+
+	return downey_rating(c, c->delta.owned, c->delta.conflicts, c->delta.foreign_owned);
+}
+
+static double speedup_reset(constraint_t *c) {
+	c->delta.owned = count_owned(c->param.agent, NULL);
+
+	return speedup_rating(c, c->delta.owned);
+}
+
+static double speedup_update(constraint_t *c, resource_t *r) {
+	c->delta.owned += delta_sign(c->param.agent, r);
+
+	return speedup_rating(c, c->delta.owned);
+}
+
+static double and_reset(constraint_t *c) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmax(c1->reset(c1), c2->reset(c2));
+}
+
+static double and_update(constraint_t *c, resource_t *r) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmax(c1->update(c1, r), c2->update(c2, r));
+}
+
+static double or_reset(constraint_t *c) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmin(c1->reset(c1), c2->reset(c2));
+}
+
+static double or_update(constraint_t *c, resource_t *r) {
+	constraint_t *c1 = c->param.args[0].constraint;
+	constraint_t *c2 = c->param.args[1].constraint;
+
+	return fmin(c1->update(c1, r), c2->update(c2, r));
+}
+
 void register_native_constraints() {
 	register_native_constraint("TILE", tile);
 	register_native_constraint("NEC_RE", nec_re);
@@ -225,5 +513,29 @@ void register_native_constraints() {
 	register_native_constraint("AND", and);
 	register_native_constraint("OR", or);
 	register_native_constraint("NOP", nop);
+
+	// undecided resources are never owned, so these ratings are admissible as they are
+	register_native_bound("TILE", nop);
+	register_native_bound("SHARE", share);
+	register_native_bound("PREFER_FREE", prefer_free);
+	register_native_bound("DOWNEY", nop);
+	register_native_bound("NOP", nop);
+
+	register_native_bound("NEC_RE", nec_re_bound);
+	register_native_bound("TYPE", type_bound);
+	register_native_bound("SPEEDUP", speedup_bound);
+	register_native_bound("AND", and_bound);
+	register_native_bound("OR", or_bound);
+
+	register_native_delta("TILE", nop, nop_update);
+	register_native_delta("NEC_RE", nec_re_reset, nec_re_update);
+	register_native_delta("TYPE", type_reset, type_update);
+	register_native_delta("SHARE", share_reset, share_update);
+	register_native_delta("PREFER_FREE", prefer_free_reset, prefer_free_update);
+	register_native_delta("DOWNEY", downey_reset, downey_update);
+	register_native_delta("SPEEDUP", speedup_reset, speedup_update);
+	register_native_delta("AND", and_reset, and_update);
+	register_native_delta("OR", or_reset, or_update);
+	register_native_delta("NOP", nop, nop_update);
 }
 
@@ -0,0 +1,210 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "console.h"
+#include "list.h"
+#include "pool.h"
+
+/*
+ * Work-stealing thread pool: every worker owns a deque of tasks, pops from its
+ * tail and steals from the head of the other workers' deques when it runs dry.
+ * Threads waiting for a task group help executing the tasks of that group.
+ */
+
+static pool_task_t * pool_pop(pool_worker_t *w, pool_group_t *g, bool steal) {
+	pool_task_t *task = NULL;
+
+	pthread_mutex_lock(&w->m);
+
+	if (steal) {
+		for_each_entry(pool_task_t, t, &w->tasks) {
+			if (!g || t->group == g) {
+				task = t;
+				break;
+			}
+		}
+	} else {
+		list_for_each_entry_reverse(task, &w->tasks, _l) {
+			if (!g || task->group == g) {
+				break;
+			}
+		}
+		if (&task->_l == &w->tasks) {
+			task = NULL;
+		}
+	}
+
+	if (task) {
+		list_del(&task->_l);
+
+		__sync_fetch_and_sub(&w->pool->queued, 1);
+	}
+
+	pthread_mutex_unlock(&w->m);
+
+	return task;
+}
+
+static pool_task_t * pool_take(pool_t *p, int id, pool_group_t *g) {
+	pool_task_t *task = NULL;
+
+	if (id >= 0) {
+		task = pool_pop(&p->workers[id], g, false);
+	}
+
+	for (int i = 1; !task && i <= p->number_of_workers; i++) {
+		int victim = (id + i + p->number_of_workers) % p->number_of_workers;
+		if (victim != id) {
+			task = pool_pop(&p->workers[victim], g, true);
+		}
+	}
+
+	return task;
+}
+
+static void pool_execute(pool_task_t *task) {
+	pool_group_t *g = task->group;
+
+	task->run(task->arg);
+
+	free(task);
+
+	pthread_mutex_lock(&g->m);
+	if (--g->pending == 0) {
+		pthread_cond_broadcast(&g->cv);
+	}
+	pthread_mutex_unlock(&g->m);
+}
+
+static void * pool_worker(void *arg) {
+	pool_worker_t *w = (pool_worker_t *) arg;
+	pool_t *p = w->pool;
+
+	while (true) {
+		pool_task_t *task = pool_take(p, w->id, NULL);
+
+		if (task) {
+			pool_execute(task);
+			continue;
+		}
+
+		pthread_mutex_lock(&p->m);
+		while (!p->stop && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0) {
+			pthread_cond_wait(&p->cv, &p->m);
+		}
+		bool stop = p->stop && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0;
+		pthread_mutex_unlock(&p->m);
+
+		if (stop) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+pool_t * pool_create(int number_of_workers) {
+	pool_t *p = (pool_t *) calloc(1, sizeof(pool_t));
+
+	p->number_of_workers = number_of_workers;
+	p->workers = (pool_worker_t *) calloc(number_of_workers, sizeof(pool_worker_t));
+	p->queued = 0;
+	p->next = 0;
+	p->stop = false;
+	pthread_mutex_init(&p->m, NULL);
+	pthread_cond_init(&p->cv, NULL);
+
+	for (int i = 0; i < number_of_workers; i++) {
+		pool_worker_t *w = &p->workers[i];
+
+		w->pool = p;
+		w->id = i;
+		pthread_mutex_init(&w->m, NULL);
+		INIT_LIST_HEAD(&w->tasks);
+	}
+
+	for (int i = 0; i < number_of_workers; i++) {
+		if (pthread_create(&p->workers[i].tid, NULL, pool_worker, &p->workers[i])) {
+			print_error("pool: failed to create worker thread %i\n", i);
+		}
+	}
+
+	return p;
+}
+
+void pool_destroy(pool_t *p) {
+	if (!p) {
+		return;
+	}
+
+	pthread_mutex_lock(&p->m);
+	p->stop = true;
+	pthread_cond_broadcast(&p->cv);
+	pthread_mutex_unlock(&p->m);
+
+	for (int i = 0; i < p->number_of_workers; i++) {
+		pthread_join(p->workers[i].tid, NULL);
+
+		pthread_mutex_destroy(&p->workers[i].m);
+	}
+
+	pthread_mutex_destroy(&p->m);
+	pthread_cond_destroy(&p->cv);
+
+	free(p->workers);
+	free(p);
+}
+
+void pool_group_init(pool_group_t *g) {
+	g->pending = 0;
+	pthread_mutex_init(&g->m, NULL);
+	pthread_cond_init(&g->cv, NULL);
+}
+
+void pool_group_destroy(pool_group_t *g) {
+	pthread_mutex_destroy(&g->m);
+	pthread_cond_destroy(&g->cv);
+}
+
+void pool_submit(pool_t *p, pool_group_t *g, void (*run)(void *), void *arg) {
+	pool_task_t *task = (pool_task_t *) calloc(1, sizeof(pool_task_t));
+	task->run = run;
+	task->arg = arg;
+	task->group = g;
+
+	pthread_mutex_lock(&g->m);
+	g->pending++;
+	pthread_mutex_unlock(&g->m);
+
+	pool_worker_t *w = &p->workers[(unsigned int) __sync_fetch_and_add(&p->next, 1) % p->number_of_workers];
+
+	pthread_mutex_lock(&w->m);
+	list_add_tail(&task->_l, &w->tasks);
+	__sync_fetch_and_add(&p->queued, 1);
+	pthread_mutex_unlock(&w->m);
+
+	pthread_mutex_lock(&p->m);
+	pthread_cond_signal(&p->cv);
+	pthread_mutex_unlock(&p->m);
+}
+
+// returns once all tasks of g have been executed, the caller helps executing them
+void pool_wait(pool_t *p, pool_group_t *g) {
+	while (true) {
+		pool_task_t *task = pool_take(p, -1, g);
+
+		if (task) {
+			pool_execute(task);
+			continue;
+		}
+
+		pthread_mutex_lock(&g->m);
+		while (g->pending > 0) {
+			pthread_cond_wait(&g->cv, &g->m);
+		}
+		pthread_mutex_unlock(&g->m);
+
+		break;
+	}
+}
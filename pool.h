@@ -0,0 +1,52 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "list.h"
+
+typedef struct pool_group {
+	int pending;
+	pthread_mutex_t m;
+	pthread_cond_t cv;
+} pool_group_t;
+
+typedef struct pool_task {
+	struct list_head _l;
+	void (*run)(void *);
+	void *arg;
+	pool_group_t *group;
+} pool_task_t;
+
+typedef struct pool_worker {
+	struct pool *pool;
+	int id;
+	pthread_t tid;
+	pthread_mutex_t m;
+	struct list_head tasks;
+} pool_worker_t;
+
+typedef struct pool {
+	int number_of_workers;
+	pool_worker_t *workers;
+	int queued;
+	int next;
+	bool stop;
+	pthread_mutex_t m;
+	pthread_cond_t cv;
+} pool_t;
+
+pool_t * pool_create(int number_of_workers);
+
+void pool_destroy(pool_t *p);
+
+void pool_group_init(pool_group_t *g);
+
+void pool_group_destroy(pool_group_t *g);
+
+void pool_submit(pool_t *p, pool_group_t *g, void (*run)(void *), void *arg);
+
+void pool_wait(pool_t *p, pool_group_t *g);
+
+#endif /* POOL_H_ */
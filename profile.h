@@ -0,0 +1,39 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+/*
+ * Per-agent phase timing, compiled in with DCOP_PROFILE (make PROFILE=1).
+ * Phases are accumulated in TSC cycles and may nest (search includes the
+ * evaluations it triggers).
+ */
+
+typedef enum {
+	PROFILE_EVALUATE,
+	PROFILE_SEARCH,
+	PROFILE_SEND,
+	PROFILE_RECV_WAIT,
+	PROFILE_BARRIER_WAIT,
+	PROFILE_ALLOC,
+	PROFILE_PHASES
+} profile_phase_t;
+
+#define PROFILE_PHASE_NAMES { "evaluate", "search", "send", "recv_wait", "barrier_wait", "alloc" }
+
+#ifdef DCOP_PROFILE
+
+#include <x86intrin.h>
+
+#define PROFILE_BEGIN(t) unsigned long long t = __rdtsc()
+
+// counters may be updated from pool threads searching for the agent
+#define PROFILE_END(counter, t) __atomic_add_fetch(&(counter), __rdtsc() - t, __ATOMIC_RELAXED)
+
+#else
+
+#define PROFILE_BEGIN(t) do {} while (0)
+
+#define PROFILE_END(counter, t) do {} while (0)
+
+#endif
+
+#endif /* PROFILE_H_ */
@@ -1,7 +1,7 @@
-#include <math.h>
 #include <stdbool.h>
 
 #include "distrm.h"
+#include "hardware.h"
 #include "list.h"
 #include "region.h"
 #include "resource.h"
@@ -13,6 +13,8 @@ region_t * region_new(distrm_agent_t *a, int size) {
 
 	region->tlm = a->agent->tlm;
 
+	region->hardware = a->agent->dcop->hardware;
+
 	region->view = view_new_tlm(region->tlm);
 
 	// actually... I think we should be able to select a region around our initial core
@@ -51,7 +53,7 @@ region_t * region_new(distrm_agent_t *a, int size) {
 	*/
 
 	for_each_entry(resource_t, r, &a->agent->view->resources) {
-		if (abs(r->index - region->center->index) <= size) {
+		if (hardware_get_distance(region->hardware, r, region->center) <= size) {
 			view_add_resource(region->view, resource_clone(r));
 		}
 	}
@@ -80,47 +82,47 @@ bool region_is_unique(region_t *region, struct list_head *list) {
 }
 
 int region_distance(region_t *region, distrm_agent_t *a) {
-	return  abs(region->center->index - a->core->index);
+	return hardware_get_distance(region->hardware, region->center, a->core);
 }
 
 bool region_contains(region_t *region, resource_t *r) {
-	return (abs(region->center->index - r->index) <= region->size);
+	return (hardware_get_distance(region->hardware, region->center, r) <= region->size);
 }
 
+// subregions are placed around uncovered cores of the region until every core of it is covered
 struct list_head * region_split(region_t *region, int size) {
 	struct list_head *subregions = tlm_malloc(region->tlm, sizeof(struct list_head));
 	INIT_LIST_HEAD(subregions);
 
-	int num_subregions = ceil((double) region->size / size);
+	for_each_entry(resource_t, r, &region->view->resources) {
+		bool covered = false;
+		for_each_entry(region_t, s, subregions) {
+			if (region_contains(s, r)) {
+				covered = true;
+				break;
+			}
+		}
+
+		if (covered) {
+			continue;
+		}
 
-	for (int i = 0; i < num_subregions; i++) {
 		region_t *subregion = tlm_malloc(region->tlm, sizeof(region_t));
 		subregion->tlm = region->tlm;
+		subregion->hardware = region->hardware;
 
 		subregion->view = view_new_tlm(region->tlm);
 
-		int j = 0;
-		for_each_entry_safe(resource_t, r, _r, &region->view->resources) {
-			view_del_resource(region->view, r);
-			view_add_resource(subregion->view, r);
+		subregion->center = resource_clone(r);
+		subregion->size = size;
 
-			j++;
-
-			if (!subregion->center && j == size) {
-				subregion->center = r;
-				j = 0;
-			} else if (j == size) {
-				break;
+		// like region_new, so the view matches region_contains
+		for_each_entry(resource_t, _r, &region->hardware->view->resources) {
+			if (hardware_get_distance(region->hardware, _r, subregion->center) <= size) {
+				view_add_resource(subregion->view, resource_clone(_r));
 			}
 		}
 
-		if (!subregion->center) {
-			subregion->center = list_entry(subregion->view->resources.next, resource_t, _l);
-			subregion->size = j - 1;
-		} else {
-			subregion->size = size;
-		}
-
 		list_add_tail(&subregion->_l, subregions);
 	}
 
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 #include "distrm.h"
+#include "hardware.h"
 #include "list.h"
 #include "resource.h"
 #include "tlm.h"
@@ -14,6 +15,7 @@ typedef struct region {
 	resource_t *center;
 	int size;
 	view_t *view;
+	hardware_t *hardware;
 	tlm_t *tlm;
 } region_t;
 
@@ -0,0 +1,191 @@
+#include <stdlib.h>
+
+#include "roi.h"
+
+#ifndef DCOP_NATIVE
+
+#include <sim_api.h>
+
+void roi_init(int number_of_agents) {
+}
+
+void roi_begin() {
+	SimRoiStart();
+}
+
+void roi_end() {
+	SimRoiEnd();
+}
+
+void roi_thread_begin(int id) {
+}
+
+void roi_thread_end(int id) {
+}
+
+void roi_set_warmup() {
+	SimSetInstrumentMode(SIM_OPT_INSTRUMENT_WARMUP);
+}
+
+void roi_set_detailed() {
+	SimSetInstrumentMode(SIM_OPT_INSTRUMENT_DETAILED);
+}
+
+void roi_print_stats() {
+}
+
+#else
+
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "scheduler.h"
+
+#define ROI_COUNTERS 4
+
+static const struct {
+	const char *name;
+	unsigned int type;
+	unsigned long long config;
+} counters[ROI_COUNTERS] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+};
+
+typedef struct roi_stats {
+	unsigned long long values[ROI_COUNTERS];
+	// counters that could not be opened stay invalid
+	bool valid[ROI_COUNTERS];
+	bool measured;
+} roi_stats_t;
+
+static roi_stats_t *stats = NULL;
+static int number_of_stats = 0;
+
+static unsigned long long start_ns = 0;
+static unsigned long long roi_ns = 0;
+
+static __thread int fds[ROI_COUNTERS] = { -1, -1, -1, -1 };
+
+static unsigned long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void roi_init(int number_of_agents) {
+	free(stats);
+
+	number_of_stats = number_of_agents + 1;
+	stats = (roi_stats_t *) calloc(number_of_stats, sizeof(roi_stats_t));
+
+	roi_ns = 0;
+}
+
+void roi_begin() {
+	start_ns = now_ns();
+}
+
+void roi_end() {
+	roi_ns += now_ns() - start_ns;
+}
+
+static int perf_event_open(struct perf_event_attr *attr) {
+	return syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+// counters are opened per thread, fibers migrate between workers and are only timed as a whole
+void roi_thread_begin(int id) {
+	if (scheduler_is_enabled() || id >= number_of_stats) {
+		return;
+	}
+
+	for (int i = 0; i < ROI_COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = counters[i].type;
+		attr.config = counters[i].config;
+		attr.exclude_hv = 1;
+
+		fds[i] = perf_event_open(&attr);
+	}
+}
+
+void roi_thread_end(int id) {
+	if (scheduler_is_enabled() || id >= number_of_stats) {
+		return;
+	}
+
+	for (int i = 0; i < ROI_COUNTERS; i++) {
+		unsigned long long value;
+
+		if (fds[i] < 0) {
+			continue;
+		}
+
+		if (read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+			stats[id].values[i] += value;
+			stats[id].valid[i] = true;
+		}
+
+		close(fds[i]);
+		fds[i] = -1;
+	}
+
+	stats[id].measured = true;
+}
+
+void roi_set_warmup() {
+}
+
+void roi_set_detailed() {
+}
+
+// formats the counters of one agent into a single line, so that the log gets one entry per agent
+static void format_counters(char *line, size_t size, unsigned long long *values, bool *valid) {
+	int n = 0;
+
+	for (int i = 0; i < ROI_COUNTERS && n < size; i++) {
+		if (!valid || valid[i]) {
+			n += snprintf(line + n, size - n, " %s %llu", counters[i].name, values[i]);
+		} else {
+			n += snprintf(line + n, size - n, " %s n/a", counters[i].name);
+		}
+	}
+}
+
+void roi_print_stats() {
+	char line[256];
+
+	print("ROI: %.3f ms\n", (double) roi_ns / 1000000);
+
+	unsigned long long total[ROI_COUNTERS] = { 0 };
+
+	for (int id = 1; id < number_of_stats; id++) {
+		if (!stats[id].measured) {
+			continue;
+		}
+
+		for (int i = 0; i < ROI_COUNTERS; i++) {
+			total[i] += stats[id].values[i];
+		}
+
+		format_counters(line, sizeof(line), stats[id].values, stats[id].valid);
+		print("ROI agent %i:%s\n", id, line);
+	}
+
+	format_counters(line, sizeof(line), total, NULL);
+	print("ROI total:%s\n", line);
+}
+
+#endif
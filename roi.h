@@ -0,0 +1,26 @@
+#ifndef ROI_H_
+#define ROI_H_
+
+/*
+ * Backend for the region of interest: the Sniper build forwards to the
+ * simulator's magic instructions, the native build (NATIVE=1) measures the ROI
+ * on the host with clock_gettime and per thread perf counters.
+ */
+
+void roi_init(int number_of_agents);
+
+void roi_begin();
+
+void roi_end();
+
+void roi_thread_begin(int id);
+
+void roi_thread_end(int id);
+
+void roi_set_warmup();
+
+void roi_set_detailed();
+
+void roi_print_stats();
+
+#endif /* ROI_H_ */
@@ -0,0 +1,427 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "console.h"
+#include "dcop.h"
+#include "list.h"
+#include "scheduler.h"
+
+/*
+ * M:N scheduler: agents run as fibers (ucontext coroutines) on a fixed number
+ * of worker threads. Every worker owns a run queue, takes fibers from its head
+ * and steals from the tail of the other queues when it runs dry. Fibers never
+ * block their worker, waiting for a message parks the fiber until a sender
+ * wakes it up again.
+ *
+ * Parking is split in two steps so that wake ups cannot get lost: the fiber
+ * announces it is PARKING while it still holds the lock protecting its wait
+ * condition and switches back to its worker. A wake up during that window
+ * turns the state into NOTIFIED, which makes the worker requeue the fiber
+ * instead of parking it.
+ *
+ * In deterministic mode there are no worker threads: the main thread runs all
+ * fibers while joining them, always picking the runnable fiber with the
+ * smallest logical time (ties broken by id). A run then only depends on the
+ * seed.
+ */
+
+static scheduler_worker_t *workers = NULL;
+static int number_of_workers = 0;
+
+static int queued = 0;
+static int next = 0;
+static bool stop = false;
+static bool deterministic = false;
+static pthread_mutex_t scheduler_m;
+static pthread_cond_t scheduler_cv;
+
+static __thread scheduler_worker_t *current_worker = NULL;
+
+static void scheduler_insert(scheduler_worker_t *w, fiber_t *f) {
+	if (!deterministic) {
+		list_add_tail(&f->_l, &w->fibers);
+
+		return;
+	}
+
+	// run queue is sorted by time and id
+	fiber_t *g;
+	list_for_each_entry_reverse(g, &w->fibers, _l) {
+		if (g->time < f->time || (g->time == f->time && g->id < f->id)) {
+			break;
+		}
+	}
+
+	list_add(&f->_l, &g->_l);
+}
+
+static void scheduler_push(scheduler_worker_t *w, fiber_t *f) {
+	pthread_mutex_lock(&w->m);
+	scheduler_insert(w, f);
+	pthread_mutex_unlock(&w->m);
+
+	__atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&scheduler_m);
+	pthread_cond_signal(&scheduler_cv);
+	pthread_mutex_unlock(&scheduler_m);
+}
+
+// fibers made runnable by a fiber stay on its worker, others are distributed round robin
+static void scheduler_enqueue(fiber_t *f) {
+	scheduler_worker_t *w = current_worker;
+
+	if (!w) {
+		w = &workers[__atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % number_of_workers];
+	}
+
+	scheduler_push(w, f);
+}
+
+static fiber_t * scheduler_pop(scheduler_worker_t *w, bool steal) {
+	fiber_t *f = NULL;
+
+	pthread_mutex_lock(&w->m);
+
+	if (!list_empty(&w->fibers)) {
+		if (steal) {
+			f = list_entry(w->fibers.prev, fiber_t, _l);
+		} else {
+			f = list_first_entry(&w->fibers, fiber_t, _l);
+		}
+
+		list_del(&f->_l);
+
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+	}
+
+	pthread_mutex_unlock(&w->m);
+
+	return f;
+}
+
+static fiber_t * scheduler_take(scheduler_worker_t *w) {
+	fiber_t *f = scheduler_pop(w, false);
+
+	for (int i = 1; !f && i < number_of_workers; i++) {
+		f = scheduler_pop(&workers[(w->id + i) % number_of_workers], true);
+	}
+
+	return f;
+}
+
+// runs f until it yields, parks or returns
+static void scheduler_switch(scheduler_worker_t *w, fiber_t *f) {
+	f->worker = w;
+	w->current = f;
+
+	__atomic_store_n(&f->state, FIBER_RUNNING, __ATOMIC_RELEASE);
+
+	swapcontext(&w->context, &f->context);
+
+	w->current = NULL;
+
+	int state = __atomic_load_n(&f->state, __ATOMIC_ACQUIRE);
+
+	switch (state) {
+		case FIBER_RUNNABLE:
+			// a yielding fiber goes behind all runnable ones, otherwise spinning fibers would starve them
+			if (deterministic && !list_empty(&w->fibers)) {
+				fiber_t *last = list_entry(w->fibers.prev, fiber_t, _l);
+				if (last->time >= f->time) {
+					f->time = last->time + 1;
+				}
+			}
+			scheduler_push(w, f);
+			break;
+
+		case FIBER_PARKING:
+			if (!__atomic_compare_exchange_n(&f->state, &state, FIBER_PARKED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				// woken up before it was parked
+				__atomic_store_n(&f->state, FIBER_RUNNABLE, __ATOMIC_RELEASE);
+				scheduler_push(w, f);
+			}
+			break;
+
+		case FIBER_NOTIFIED:
+			__atomic_store_n(&f->state, FIBER_RUNNABLE, __ATOMIC_RELEASE);
+			scheduler_push(w, f);
+			break;
+
+		case FIBER_DONE:
+			pthread_mutex_lock(&f->m);
+			f->done = true;
+			pthread_cond_broadcast(&f->cv);
+			pthread_mutex_unlock(&f->m);
+			break;
+
+		default:
+			print_error("scheduler: fiber switched back in state %i\n", state);
+			break;
+	}
+}
+
+static void * scheduler_worker(void *arg) {
+	scheduler_worker_t *w = (scheduler_worker_t *) arg;
+
+	current_worker = w;
+
+	while (true) {
+		fiber_t *f = scheduler_take(w);
+
+		if (f) {
+			scheduler_switch(w, f);
+			continue;
+		}
+
+		pthread_mutex_lock(&scheduler_m);
+		while (!stop && __atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0) {
+			pthread_cond_wait(&scheduler_cv, &scheduler_m);
+		}
+		bool done = stop && __atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0;
+		pthread_mutex_unlock(&scheduler_m);
+
+		if (done) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int scheduler_start(int n) {
+	if (n <= 0) {
+		n = dcop_get_number_of_cores();
+	}
+
+	number_of_workers = n;
+	workers = (scheduler_worker_t *) calloc(n, sizeof(scheduler_worker_t));
+
+	queued = 0;
+	next = 0;
+	stop = false;
+	pthread_mutex_init(&scheduler_m, NULL);
+	pthread_cond_init(&scheduler_cv, NULL);
+
+	for (int i = 0; i < n; i++) {
+		workers[i].id = i;
+		pthread_mutex_init(&workers[i].m, NULL);
+		INIT_LIST_HEAD(&workers[i].fibers);
+	}
+
+	for (int i = 0; i < n; i++) {
+		if (pthread_create(&workers[i].tid, NULL, scheduler_worker, &workers[i])) {
+			print_error("scheduler: failed to create worker thread %i\n", i);
+
+			return -1;
+		}
+	}
+
+	print("scheduler: running agents on %i worker threads\n", n);
+
+	return 0;
+}
+
+int scheduler_start_deterministic() {
+	deterministic = true;
+
+	number_of_workers = 1;
+	workers = (scheduler_worker_t *) calloc(1, sizeof(scheduler_worker_t));
+
+	queued = 0;
+	next = 0;
+	stop = false;
+	pthread_mutex_init(&scheduler_m, NULL);
+	pthread_cond_init(&scheduler_cv, NULL);
+
+	pthread_mutex_init(&workers[0].m, NULL);
+	INIT_LIST_HEAD(&workers[0].fibers);
+
+	print("scheduler: running agents deterministically on the main thread\n");
+
+	return 0;
+}
+
+// runs fibers on the calling thread until f is done
+static void scheduler_run_until(fiber_t *f) {
+	scheduler_worker_t *w = &workers[0];
+
+	current_worker = w;
+
+	while (!f->done) {
+		fiber_t *g = scheduler_pop(w, false);
+		if (!g) {
+			print_error("scheduler: all agents are blocked\n");
+			break;
+		}
+
+		scheduler_switch(w, g);
+	}
+
+	current_worker = NULL;
+}
+
+void scheduler_stop() {
+	if (!workers) {
+		return;
+	}
+
+	pthread_mutex_lock(&scheduler_m);
+	stop = true;
+	pthread_cond_broadcast(&scheduler_cv);
+	pthread_mutex_unlock(&scheduler_m);
+
+	for (int i = 0; i < number_of_workers; i++) {
+		if (!deterministic) {
+			pthread_join(workers[i].tid, NULL);
+		}
+		pthread_mutex_destroy(&workers[i].m);
+	}
+
+	pthread_mutex_destroy(&scheduler_m);
+	pthread_cond_destroy(&scheduler_cv);
+
+	free(workers);
+	workers = NULL;
+	number_of_workers = 0;
+	deterministic = false;
+}
+
+bool scheduler_is_enabled() {
+	return (workers != NULL);
+}
+
+bool scheduler_is_deterministic() {
+	return deterministic;
+}
+
+// fibers may resume on another worker, so the thread local must not be cached across a switch
+__attribute__((noinline)) fiber_t * scheduler_current() {
+	return (current_worker ? current_worker->current : NULL);
+}
+
+static void fiber_main() {
+	fiber_t *f = scheduler_current();
+
+	f->ret = f->run(f->arg);
+
+	__atomic_store_n(&f->state, FIBER_DONE, __ATOMIC_RELEASE);
+
+	swapcontext(&f->context, &f->worker->context);
+}
+
+fiber_t * scheduler_spawn(int id, void * (*run)(void *), void *arg) {
+	fiber_t *f = (fiber_t *) calloc(1, sizeof(fiber_t));
+
+	// stacks are only backed by memory once touched, the lowest page guards against overflows
+	f->stack = mmap(NULL, FIBER_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (f->stack == MAP_FAILED) {
+		print_error("scheduler: failed to allocate fiber stack\n");
+		free(f);
+
+		return NULL;
+	}
+	mprotect(f->stack, sysconf(_SC_PAGE_SIZE), PROT_NONE);
+
+	f->run = run;
+	f->arg = arg;
+	f->state = FIBER_RUNNABLE;
+	f->id = id;
+	f->time = 0;
+	f->done = false;
+	pthread_mutex_init(&f->m, NULL);
+	pthread_cond_init(&f->cv, NULL);
+
+	getcontext(&f->context);
+	f->context.uc_stack.ss_sp = f->stack;
+	f->context.uc_stack.ss_size = FIBER_STACK_SIZE;
+	f->context.uc_link = NULL;
+	makecontext(&f->context, fiber_main, 0);
+
+	scheduler_enqueue(f);
+
+	return f;
+}
+
+void * scheduler_join(fiber_t *f) {
+	// a fiber joining another one must not block its worker
+	if (scheduler_current()) {
+		while (!__atomic_load_n(&f->done, __ATOMIC_ACQUIRE)) {
+			scheduler_yield();
+		}
+
+		return f->ret;
+	}
+
+	if (deterministic) {
+		scheduler_run_until(f);
+
+		return f->ret;
+	}
+
+	pthread_mutex_lock(&f->m);
+	while (!f->done) {
+		pthread_cond_wait(&f->cv, &f->m);
+	}
+	pthread_mutex_unlock(&f->m);
+
+	return f->ret;
+}
+
+void scheduler_free(fiber_t *f) {
+	munmap(f->stack, FIBER_STACK_SIZE);
+
+	pthread_mutex_destroy(&f->m);
+	pthread_cond_destroy(&f->cv);
+
+	free(f);
+}
+
+void scheduler_yield() {
+	fiber_t *f = scheduler_current();
+	if (!f) {
+		return;
+	}
+
+	__atomic_store_n(&f->state, FIBER_RUNNABLE, __ATOMIC_RELEASE);
+
+	swapcontext(&f->context, &f->worker->context);
+}
+
+// has to be called while holding the lock protecting the condition the fiber waits for
+void scheduler_prepare_park(fiber_t *f) {
+	__atomic_store_n(&f->state, FIBER_PARKING, __ATOMIC_RELEASE);
+}
+
+void scheduler_park(fiber_t *f) {
+	swapcontext(&f->context, &f->worker->context);
+}
+
+// time is the logical time of the event waking f
+void scheduler_wake(fiber_t *f, unsigned long time) {
+	while (true) {
+		int state = __atomic_load_n(&f->state, __ATOMIC_ACQUIRE);
+
+		if (state == FIBER_PARKED) {
+			if (__atomic_compare_exchange_n(&f->state, &state, FIBER_RUNNABLE, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				if (time > f->time) {
+					f->time = time;
+				}
+
+				scheduler_enqueue(f);
+				return;
+			}
+		} else if (state == FIBER_PARKING) {
+			if (__atomic_compare_exchange_n(&f->state, &state, FIBER_NOTIFIED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				return;
+			}
+		} else {
+			// running fibers check their condition before parking
+			return;
+		}
+	}
+}
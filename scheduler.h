@@ -0,0 +1,74 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <ucontext.h>
+
+#include "list.h"
+
+#define FIBER_STACK_SIZE (1 << 20)
+
+typedef enum {
+	FIBER_RUNNABLE,
+	FIBER_RUNNING,
+	FIBER_PARKING,
+	FIBER_PARKED,
+	FIBER_NOTIFIED,
+	FIBER_DONE
+} fiber_state_t;
+
+typedef struct fiber {
+	struct list_head _l;
+	ucontext_t context;
+	void *stack;
+	void * (*run)(void *);
+	void *arg;
+	void *ret;
+	int state;
+	// deterministic mode runs fibers in order of logical time, then id
+	int id;
+	unsigned long time;
+	// worker the fiber currently runs on
+	struct scheduler_worker *worker;
+	bool done;
+	pthread_mutex_t m;
+	pthread_cond_t cv;
+} fiber_t;
+
+typedef struct scheduler_worker {
+	int id;
+	pthread_t tid;
+	ucontext_t context;
+	fiber_t *current;
+	pthread_mutex_t m;
+	struct list_head fibers;
+} scheduler_worker_t;
+
+int scheduler_start(int number_of_workers);
+
+int scheduler_start_deterministic();
+
+void scheduler_stop();
+
+bool scheduler_is_enabled();
+
+bool scheduler_is_deterministic();
+
+fiber_t * scheduler_spawn(int id, void * (*run)(void *), void *arg);
+
+void * scheduler_join(fiber_t *f);
+
+void scheduler_free(fiber_t *f);
+
+fiber_t * scheduler_current();
+
+void scheduler_yield();
+
+void scheduler_prepare_park(fiber_t *f);
+
+void scheduler_park(fiber_t *f);
+
+void scheduler_wake(fiber_t *f, unsigned long time);
+
+#endif /* SCHEDULER_H_ */
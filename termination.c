@@ -0,0 +1,161 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "agent.h"
+#include "console.h"
+#include "dcop.h"
+#include "list.h"
+#include "termination.h"
+
+/*
+ * Safra's termination detection: every agent counts the basic messages it
+ * sent minus the ones it received and turns black on receiving one. A token
+ * is passed along a ring of all agents, but only by passive agents, and sums
+ * up the counters. Termination is detected once the token returns white to
+ * the initiator (the first agent of the ring) and the sum is 0.
+ *
+ * The token is forwarded by the thread making an agent passive, on behalf of
+ * all passive agents following in the ring.
+ */
+
+termination_t * termination_new(dcop_t *dcop, void (*detected)(dcop_t *)) {
+	termination_t *t = (termination_t *) calloc(1, sizeof(termination_t));
+
+	t->dcop = dcop;
+	t->number_of_agents = dcop->number_of_agents;
+	t->states = (termination_state_t *) calloc(t->number_of_agents, sizeof(termination_state_t));
+	t->detected = detected;
+	t->terminated = false;
+	t->waves = 0;
+
+	int i = 0;
+	for_each_entry(agent_t, a, &dcop->agents) {
+		termination_state_t *s = &t->states[i];
+
+		pthread_mutex_init(&s->m, NULL);
+		s->agent = a;
+		s->next = &t->states[(i + 1) % t->number_of_agents];
+
+		a->termination = t;
+		a->termination_state = s;
+
+		i++;
+	}
+
+	// the initiator starts the first wave once it becomes passive
+	if (t->number_of_agents > 0) {
+		t->states[0].token = true;
+	}
+
+	return t;
+}
+
+void termination_free(termination_t *t) {
+	if (!t) {
+		return;
+	}
+
+	for (int i = 0; i < t->number_of_agents; i++) {
+		t->states[i].agent->termination = NULL;
+		t->states[i].agent->termination_state = NULL;
+
+		pthread_mutex_destroy(&t->states[i].m);
+	}
+
+	free(t->states);
+	free(t);
+}
+
+#define is_basic(msg) (msg->from && !msg->control)
+
+void termination_sent(agent_t *a, message_t *msg) {
+	termination_state_t *s = a->termination_state;
+
+	if (!s || !is_basic(msg)) {
+		return;
+	}
+
+	pthread_mutex_lock(&s->m);
+	s->counter++;
+	pthread_mutex_unlock(&s->m);
+}
+
+void termination_received(agent_t *a, message_t *msg) {
+	termination_state_t *s = a->termination_state;
+
+	if (!s || !is_basic(msg)) {
+		return;
+	}
+
+	pthread_mutex_lock(&s->m);
+	s->counter--;
+	s->black = true;
+	s->passive = false;
+	pthread_mutex_unlock(&s->m);
+}
+
+static void forward_token(termination_t *t, termination_state_t *s) {
+	while (true) {
+		pthread_mutex_lock(&s->m);
+
+		if (!s->passive || !s->token || __atomic_load_n(&t->terminated, __ATOMIC_SEQ_CST)) {
+			pthread_mutex_unlock(&s->m);
+			return;
+		}
+
+		s->token = false;
+
+		long q = s->q;
+		bool token_black = s->token_black;
+
+		if (s == &t->states[0]) {
+			if (t->waves > 0 && !token_black && !s->black && q + s->counter == 0) {
+				__atomic_store_n(&t->terminated, true, __ATOMIC_SEQ_CST);
+
+				pthread_mutex_unlock(&s->m);
+
+				print("termination detected after %i waves\n", t->waves);
+
+				t->detected(t->dcop);
+
+				return;
+			}
+
+			// a new wave is started
+			t->waves++;
+			q = 0;
+			token_black = false;
+		} else {
+			q += s->counter;
+			token_black = token_black || s->black;
+		}
+
+		s->black = false;
+
+		pthread_mutex_unlock(&s->m);
+
+		s = s->next;
+
+		pthread_mutex_lock(&s->m);
+		s->token = true;
+		s->q = q;
+		s->token_black = token_black;
+		pthread_mutex_unlock(&s->m);
+	}
+}
+
+// the agent is idle until it receives a basic message
+void termination_set_passive(agent_t *a) {
+	termination_state_t *s = a->termination_state;
+
+	if (!s) {
+		return;
+	}
+
+	pthread_mutex_lock(&s->m);
+	s->passive = true;
+	pthread_mutex_unlock(&s->m);
+
+	forward_token(a->termination, s);
+}
@@ -0,0 +1,45 @@
+#ifndef TERMINATION_H_
+#define TERMINATION_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef struct termination termination_t;
+
+#include "agent.h"
+#include "dcop.h"
+
+typedef struct termination_state {
+	pthread_mutex_t m;
+	agent_t *agent;
+	struct termination_state *next;
+	long counter;
+	bool black;
+	bool passive;
+	bool token;
+	long q;
+	bool token_black;
+} termination_state_t;
+
+struct termination {
+	dcop_t *dcop;
+	int number_of_agents;
+	termination_state_t *states;
+	void (*detected)(dcop_t *);
+	bool terminated;
+	int waves;
+};
+
+termination_t * termination_new(dcop_t *dcop, void (*detected)(dcop_t *));
+
+void termination_free(termination_t *t);
+
+void termination_sent(agent_t *a, message_t *msg);
+
+void termination_received(agent_t *a, message_t *msg);
+
+void termination_set_passive(agent_t *a);
+
+#define message_set_control(msg) do { (msg)->control = true; } while (0)
+
+#endif /* TERMINATION_H_ */
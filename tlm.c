@@ -4,6 +4,7 @@
 
 #include "console.h"
 #include "list.h"
+#include "profile.h"
 #include "tlm.h"
 
 //#define MAX_ENTRIES 8192
@@ -32,7 +33,7 @@ tlm_t * tlm_create(size_t kbytes) {
 	return tlm;
 }
 
-void * tlm_malloc(tlm_t *tlm, size_t size) {
+static void * __tlm_malloc(tlm_t *tlm, size_t size) {
 	if (!tlm) {
 		return calloc(1, size);
 	}
@@ -121,7 +122,7 @@ static tlm_entry_t * tlm_next(tlm_t *tlm, tlm_entry_t *e) {
 	return NULL;
 }
 
-void tlm_free(tlm_t *tlm, void *p) {
+static void __tlm_free(tlm_t *tlm, void *p) {
 	if (!tlm) {
 		free(p);
 
@@ -165,6 +166,34 @@ void tlm_free(tlm_t *tlm, void *p) {
 	pthread_mutex_unlock(&tlm->m);
 }
 
+void * tlm_malloc(tlm_t *tlm, size_t size) {
+	if (!tlm) {
+		return calloc(1, size);
+	}
+
+	PROFILE_BEGIN(t);
+
+	void *p = __tlm_malloc(tlm, size);
+
+	PROFILE_END(tlm->alloc_cycles, t);
+
+	return p;
+}
+
+void tlm_free(tlm_t *tlm, void *p) {
+	if (!tlm) {
+		free(p);
+
+		return;
+	}
+
+	PROFILE_BEGIN(t);
+
+	__tlm_free(tlm, p);
+
+	PROFILE_END(tlm->alloc_cycles, t);
+}
+
 void tlm_destroy(tlm_t *tlm) {
 	if (tlm) {
 		free(tlm->base);
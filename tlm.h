@@ -22,6 +22,9 @@ typedef struct tlm {
 	pthread_mutex_t m;
 	size_t cur_used;
 	size_t max_used;
+#ifdef DCOP_PROFILE
+	unsigned long long alloc_cycles;
+#endif
 } tlm_t;
 
 tlm_t * tlm_create(size_t kbytes);